@@ -18,27 +18,42 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+function operation_done(success, id) {
+  if (!success)
+    console.warn("Apps2Desktop: operation on app " + id + " failed");
+}
+
+function sync_done(counts) {
+  if (counts.failed > 0)
+    console.warn("Apps2Desktop: sync of " + counts.failed + " apps failed");
+}
+
+function operation_queued(depth) {
+  if (depth < 0)
+    console.warn("Apps2Desktop: operation queue is full");
+}
+
 function add_app(info) {
   installer = document.getElementById("Apps2Desktop");
   if (info.isApp)
-    installer.add(info.name, info.id, info.version, info.appLaunchUrl, info.enabled);
+    operation_queued(installer.add(info.name, info.id, info.version, info.appLaunchUrl, info.enabled, operation_done));
 }
 
 function enable_app(info) {
   installer = document.getElementById("Apps2Desktop");
   if (info.isApp)
-    installer.enable(info.id);
+    operation_queued(installer.enable(info.id, operation_done));
 }
 
 function disable_app(info) {
   installer = document.getElementById("Apps2Desktop");
   if (info.isApp)
-    installer.disable(info.id);
+    operation_queued(installer.disable(info.id, operation_done));
 }
 
 function remove_app(id) {
   installer = document.getElementById("Apps2Desktop");
-  installer.remove(id);
+  operation_queued(installer.remove(id, operation_done));
 }
 
 document.addEventListener('DOMContentLoaded', function () {
@@ -49,9 +64,12 @@ document.addEventListener('DOMContentLoaded', function () {
 
   installer = document.getElementById("Apps2Desktop");
   chrome.management.getAll(function(info) {
+    var apps = [];
     for (var i = 0; i < info.length; i++) {
-        add_app(info[i]);
+      if (info[i].isApp)
+        apps.push(info[i]);
     }
+    installer.sync(apps, sync_done);
   });
 });
 
@@ -0,0 +1,301 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <glib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "a2d-arena.h"
+#include "a2d-stats.h"
+
+#define ARENA_ALIGNMENT (2 * sizeof (gpointer))
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+typedef struct A2DArenaBlock A2DArenaBlock;
+
+struct A2DArenaBlock
+{
+    A2DArenaBlock	*next;
+    gsize		 size;
+    gsize		 used;
+    /* followed by size bytes of data */
+};
+
+#define BLOCK_HEADER_SIZE ARENA_ALIGN (sizeof (A2DArenaBlock))
+#define BLOCK_DATA(block) ((gchar *) (block) + BLOCK_HEADER_SIZE)
+
+/*
+ * Bump allocator for temporary strings of one operation. Allocations are
+ * never freed one by one, all of them are released by a2d_arena_reset, so
+ * error paths can't leak them.
+ */
+struct A2DArena
+{
+    /* block allocated last is the first */
+    A2DArenaBlock	*blocks;
+    gsize		 block_size;
+    guint		 allocations;
+};
+
+static A2DArenaBlock *
+block_new (gsize size, A2DArenaBlock *next)
+{
+    A2DArenaBlock *block = g_malloc (BLOCK_HEADER_SIZE + size);
+
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+
+    a2d_stats_add (A2D_STAT_ARENA_BLOCKS, 1);
+
+    return block;
+}
+
+static void
+blocks_free (A2DArenaBlock *block)
+{
+    while (block) {
+        A2DArenaBlock *next = block->next;
+
+        g_free (block);
+        block = next;
+    }
+}
+
+/*
+ * flush_stats:
+ *
+ * Adds allocations since the last reset to the counters.
+ */
+static void
+flush_stats (A2DArena *arena)
+{
+    if (!arena->allocations)
+        return;
+
+    a2d_stats_add (A2D_STAT_ARENA_ALLOCATIONS, arena->allocations);
+    a2d_stats_set_max (A2D_STAT_ARENA_MAX_ALLOCATIONS, arena->allocations);
+    arena->allocations = 0;
+}
+
+/*
+ * a2d_arena_new:
+ *
+ * Creates arena, which allocates memory from the system in blocks of
+ * block_size bytes.
+ */
+A2DArena *
+a2d_arena_new (gsize block_size)
+{
+    A2DArena *arena = g_new0 (A2DArena, 1);
+
+    arena->block_size = ARENA_ALIGN (block_size);
+
+    return arena;
+}
+
+/*
+ * a2d_arena_free:
+ */
+void
+a2d_arena_free (A2DArena *arena)
+{
+    if (!arena)
+        return;
+
+    flush_stats (arena);
+    blocks_free (arena->blocks);
+    g_free (arena);
+}
+
+/*
+ * a2d_arena_reset:
+ *
+ * Releases all allocations. One block is kept for reuse, when the operation
+ * needed more blocks, the kept one is grown to hold all of their data, so the
+ * next operation of the same size fits into it.
+ */
+void
+a2d_arena_reset (A2DArena *arena)
+{
+    A2DArenaBlock *block;
+    gsize used = 0;
+
+    flush_stats (arena);
+
+    if (!arena->blocks)
+        return;
+
+    if (!arena->blocks->next) {
+        arena->blocks->used = 0;
+        return;
+    }
+
+    for (block = arena->blocks; block; block = block->next)
+        used += block->used;
+
+    blocks_free (arena->blocks);
+
+    arena->block_size = MAX (arena->block_size, ARENA_ALIGN (used));
+    arena->blocks = block_new (arena->block_size, NULL);
+}
+
+/*
+ * a2d_arena_get_allocations:
+ *
+ * Returns number of allocations since the last reset.
+ */
+guint
+a2d_arena_get_allocations (A2DArena *arena)
+{
+    return arena->allocations;
+}
+
+/*
+ * a2d_arena_alloc:
+ *
+ * Returns size bytes of memory, which are valid until the next reset.
+ */
+gpointer
+a2d_arena_alloc (A2DArena *arena, gsize size)
+{
+    A2DArenaBlock *block = arena->blocks;
+    gpointer data;
+
+    size = ARENA_ALIGN (MAX (size, 1));
+
+    if (!block || block->size - block->used < size)
+        block = arena->blocks = block_new (MAX (arena->block_size, size), arena->blocks);
+
+    data = BLOCK_DATA (block) + block->used;
+    block->used += size;
+    arena->allocations++;
+
+    return data;
+}
+
+/*
+ * a2d_arena_strdup:
+ */
+gchar *
+a2d_arena_strdup (A2DArena *arena, const gchar *string)
+{
+    gsize length;
+    gchar *copy;
+
+    if (!string)
+        return NULL;
+
+    length = strlen (string) + 1;
+    copy = a2d_arena_alloc (arena, length);
+    memcpy (copy, string, length);
+
+    return copy;
+}
+
+/*
+ * a2d_arena_strndup:
+ *
+ * Copies at most length bytes of string, the copy is always terminated.
+ */
+gchar *
+a2d_arena_strndup (A2DArena *arena, const gchar *string, gsize length)
+{
+    gchar *copy;
+
+    if (!string)
+        return NULL;
+
+    length = strnlen (string, length);
+    copy = a2d_arena_alloc (arena, length + 1);
+    memcpy (copy, string, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+/*
+ * a2d_arena_strconcat:
+ *
+ * Concatenates NULL terminated list of strings like g_strconcat.
+ */
+gchar *
+a2d_arena_strconcat (A2DArena *arena, const gchar *first, ...)
+{
+    va_list args;
+    const gchar *string;
+    gsize length = 1;
+    gchar *result, *pos;
+
+    if (!first)
+        return NULL;
+
+    va_start (args, first);
+    for (string = first; string; string = va_arg (args, const gchar *))
+        length += strlen (string);
+    va_end (args);
+
+    result = pos = a2d_arena_alloc (arena, length);
+
+    va_start (args, first);
+    for (string = first; string; string = va_arg (args, const gchar *)) {
+        gsize string_length = strlen (string);
+
+        memcpy (pos, string, string_length);
+        pos += string_length;
+    }
+    va_end (args);
+
+    *pos = '\0';
+
+    return result;
+}
+
+/*
+ * a2d_arena_printf:
+ *
+ * Formats string like g_strdup_printf.
+ */
+gchar *
+a2d_arena_printf (A2DArena *arena, const gchar *format, ...)
+{
+    va_list args;
+    gint length;
+    gchar *result;
+
+    va_start (args, format);
+    length = g_vsnprintf (NULL, 0, format, args);
+    va_end (args);
+
+    if (length < 0)
+        return NULL;
+
+    result = a2d_arena_alloc (arena, length + 1);
+
+    va_start (args, format);
+    g_vsnprintf (result, length + 1, format, args);
+    va_end (args);
+
+    return result;
+}
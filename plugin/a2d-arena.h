@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#ifndef __A2D_ARENA_H
+#define __A2D_ARENA_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct A2DArena A2DArena;
+
+A2DArena *	a2d_arena_new				(gsize block_size);
+void		a2d_arena_free				(A2DArena *arena);
+void		a2d_arena_reset				(A2DArena *arena);
+guint		a2d_arena_get_allocations		(A2DArena *arena);
+gpointer	a2d_arena_alloc				(A2DArena *arena,
+							 gsize size);
+gchar *		a2d_arena_strdup			(A2DArena *arena,
+							 const gchar *string);
+gchar *		a2d_arena_strndup			(A2DArena *arena,
+							 const gchar *string,
+							 gsize length);
+gchar *		a2d_arena_strconcat			(A2DArena *arena,
+							 const gchar *first,
+							 ...) G_GNUC_NULL_TERMINATED;
+gchar *		a2d_arena_printf			(A2DArena *arena,
+							 const gchar *format,
+							 ...) G_GNUC_PRINTF (2, 3);
+
+G_END_DECLS
+
+#endif /* __A2D_ARENA_H */
@@ -0,0 +1,459 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "a2d-commit.h"
+#include "a2d-stats.h"
+
+/* Names of durability modes, indexed by A2DDurability */
+static const gchar *durability_names[] = {
+    NULL,
+    "fsync",
+    "group",
+    "none"
+};
+
+/*
+ * Writes of one batch. With the fsync and none modes files are written
+ * immediately, with the group mode they are kept in memory until the batch
+ * is finished and then committed together. Operations of the batch may run in
+ * parallel, the finish is called when they are done.
+ */
+struct A2DCommit
+{
+    A2DDurability	 durability;
+    GMutex		 mutex;		/* protects pending, order and links */
+    GHashTable		*pending;	/* filename -> GBytes */
+    GPtrArray		*order;		/* filenames in order of the first write */
+    GHashTable		*links;		/* filename -> target of symlink */
+};
+
+A2DDurability
+a2d_durability_from_string (const gchar *string)
+{
+    guint ii;
+
+    for (ii = A2D_DURABILITY_FSYNC; ii < G_N_ELEMENTS (durability_names); ii++) {
+        if (g_strcmp0 (string, durability_names[ii]) == 0)
+            return ii;
+    }
+
+    return A2D_DURABILITY_INVALID;
+}
+
+const gchar *
+a2d_durability_to_string (A2DDurability durability)
+{
+    g_return_val_if_fail (durability < G_N_ELEMENTS (durability_names), NULL);
+
+    return durability_names[durability];
+}
+
+/*
+ * write_all:
+ */
+static gboolean
+write_all (gint fd, const gchar *contents, gsize length)
+{
+    while (length > 0) {
+        gssize written = write (fd, contents, length);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return FALSE;
+        }
+
+        contents += written;
+        length -= written;
+    }
+
+    return TRUE;
+}
+
+/*
+ * write_temporary:
+ *
+ * Writes contents to a new file next to filename. Returns name of the file or
+ * NULL on failure.
+ */
+static gchar *
+write_temporary (const gchar *filename, const gchar *contents, gsize length)
+{
+    gchar *temporary = g_strconcat (filename, ".XXXXXX", NULL);
+    gint fd = g_mkstemp_full (temporary, O_RDWR | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+        goto error;
+
+    if (!write_all (fd, contents, length)) {
+        close (fd);
+        g_unlink (temporary);
+
+        goto error;
+    }
+
+    if (close (fd) < 0) {
+        g_unlink (temporary);
+
+        goto error;
+    }
+
+    return temporary;
+
+ error:
+    g_free (temporary);
+
+    return NULL;
+}
+
+/*
+ * write_unsynced:
+ *
+ * Replaces file atomically, but without waiting for the data to hit the disk.
+ */
+static gboolean
+write_unsynced (const gchar *filename, const gchar *contents, gsize length)
+{
+    gchar *temporary = write_temporary (filename, contents, length);
+    gboolean ret_val = FALSE;
+
+    if (!temporary)
+        return FALSE;
+
+    if (g_rename (temporary, filename) == 0)
+        ret_val = TRUE;
+    else
+        g_unlink (temporary);
+
+    g_free (temporary);
+
+    return ret_val;
+}
+
+/*
+ * sync_directories:
+ *
+ * Syncs file systems of given directories once (syncfs) or each directory
+ * (fsync) when sync_file_systems is FALSE.
+ */
+static void
+sync_directories (GHashTable *directories, gboolean sync_file_systems)
+{
+    GArray *devices = g_array_new (FALSE, FALSE, sizeof (dev_t));
+    GHashTableIter iter;
+    gpointer directory;
+
+    g_hash_table_iter_init (&iter, directories);
+    while (g_hash_table_iter_next (&iter, &directory, NULL)) {
+        struct stat stat_buf;
+        gboolean synced = FALSE;
+        gint fd = open (directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        guint ii;
+
+        if (fd < 0)
+            continue;
+
+        if (sync_file_systems && fstat (fd, &stat_buf) == 0) {
+            for (ii = 0; ii < devices->len && !synced; ii++)
+                synced = g_array_index (devices, dev_t, ii) == stat_buf.st_dev;
+
+            if (!synced) {
+                g_array_append_val (devices, stat_buf.st_dev);
+                syncfs (fd);
+                a2d_stats_add (A2D_STAT_COMMIT_SYNCS, 1);
+            }
+        } else {
+            fsync (fd);
+            a2d_stats_add (A2D_STAT_COMMIT_SYNCS, 1);
+        }
+
+        close (fd);
+    }
+
+    g_array_free (devices, TRUE);
+}
+
+/*
+ * commit_pending:
+ *
+ * Writes all pending files to temporary files, syncs them with one syncfs per
+ * file system, renames them over the originals and syncs the directories, so
+ * the renames are durable too. Symlinks are created when all files were
+ * written.
+ */
+static gboolean
+commit_pending (A2DCommit *commit)
+{
+    GHashTable *directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    GPtrArray *temporaries = g_ptr_array_new_with_free_func (g_free);
+    gboolean ret_val = TRUE;
+    guint ii;
+
+    for (ii = 0; ii < commit->order->len; ii++) {
+        const gchar *filename = g_ptr_array_index (commit->order, ii);
+        GBytes *bytes = g_hash_table_lookup (commit->pending, filename);
+        gsize length;
+        const gchar *contents;
+
+        contents = g_bytes_get_data (bytes, &length);
+        g_ptr_array_add (temporaries, write_temporary (filename, contents, length));
+
+        if (!g_ptr_array_index (temporaries, ii))
+            ret_val = FALSE;
+
+        g_hash_table_add (directories, g_path_get_dirname (filename));
+    }
+
+    sync_directories (directories, TRUE);
+
+    for (ii = 0; ii < commit->order->len; ii++) {
+        const gchar *temporary = g_ptr_array_index (temporaries, ii);
+
+        if (!temporary)
+            continue;
+
+        if (g_rename (temporary, g_ptr_array_index (commit->order, ii)) != 0) {
+            g_unlink (temporary);
+            ret_val = FALSE;
+        }
+    }
+
+    sync_directories (directories, FALSE);
+
+    if (ret_val) {
+        GHashTableIter iter;
+        gpointer filename, target;
+
+        g_hash_table_iter_init (&iter, commit->links);
+        while (g_hash_table_iter_next (&iter, &filename, &target))
+            symlink (target, filename);
+    }
+
+    g_ptr_array_free (temporaries, TRUE);
+    g_hash_table_destroy (directories);
+
+    return ret_val;
+}
+
+/*
+ * a2d_commit_new:
+ *
+ * Starts writes of one batch with given durability.
+ */
+A2DCommit *
+a2d_commit_new (A2DDurability durability)
+{
+    A2DCommit *commit = g_new0 (A2DCommit, 1);
+
+    commit->durability = durability;
+    g_mutex_init (&commit->mutex);
+    commit->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             (GDestroyNotify) g_bytes_unref);
+    commit->order = g_ptr_array_new_with_free_func (g_free);
+    commit->links = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    return commit;
+}
+
+/*
+ * a2d_commit_write:
+ *
+ * Replaces contents of the file. With the group mode the file is written when
+ * the commit is finished.
+ */
+gboolean
+a2d_commit_write (A2DCommit *commit, const gchar *filename,
+                  const gchar *contents, gsize length)
+{
+    gint64 write_start = a2d_stats_get_time_ns ();
+    gboolean ret_val = TRUE;
+
+    switch (commit->durability) {
+    case A2D_DURABILITY_GROUP:
+        g_mutex_lock (&commit->mutex);
+
+        if (!g_hash_table_contains (commit->pending, filename))
+            g_ptr_array_add (commit->order, g_strdup (filename));
+
+        g_hash_table_insert (commit->pending, g_strdup (filename),
+                             g_bytes_new (contents, length));
+
+        g_mutex_unlock (&commit->mutex);
+        break;
+    case A2D_DURABILITY_NONE:
+        ret_val = write_unsynced (filename, contents, length);
+        break;
+    default:
+        ret_val = g_file_set_contents (filename, contents, length, NULL);
+        a2d_stats_add (A2D_STAT_COMMIT_SYNCS, 1);
+        break;
+    }
+
+    a2d_stats_add (A2D_STAT_COMMIT_FILES, 1);
+    a2d_stats_add (A2D_STAT_COMMIT_NSEC, a2d_stats_get_time_ns () - write_start);
+
+    return ret_val;
+}
+
+/*
+ * a2d_commit_symlink:
+ *
+ * Creates symlink to target. With the group mode it's created when the commit
+ * is finished, after the files, and not at all when they couldn't be written.
+ * As with symlink, existing file isn't replaced.
+ */
+gboolean
+a2d_commit_symlink (A2DCommit *commit, const gchar *target, const gchar *filename)
+{
+    if (commit->durability != A2D_DURABILITY_GROUP)
+        return symlink (target, filename) == 0;
+
+    g_mutex_lock (&commit->mutex);
+    g_hash_table_insert (commit->links, g_strdup (filename), g_strdup (target));
+    g_mutex_unlock (&commit->mutex);
+
+    return TRUE;
+}
+
+/*
+ * a2d_commit_read:
+ *
+ * Reads contents of the file as written in this commit. Returned contents
+ * should be freed with g_free.
+ */
+gboolean
+a2d_commit_read (A2DCommit *commit, const gchar *filename,
+                 gchar **contents, gsize *length)
+{
+    GBytes *bytes;
+    gconstpointer data;
+    gsize size;
+
+    g_mutex_lock (&commit->mutex);
+    bytes = g_hash_table_lookup (commit->pending, filename);
+    if (bytes)
+        g_bytes_ref (bytes);
+    g_mutex_unlock (&commit->mutex);
+
+    if (!bytes)
+        return g_file_get_contents (filename, contents, length, NULL);
+
+    data = g_bytes_get_data (bytes, &size);
+
+    *contents = g_malloc (size + 1);
+    memcpy (*contents, data, size);
+    (*contents)[size] = '\0';
+
+    if (length)
+        *length = size;
+
+    g_bytes_unref (bytes);
+
+    return TRUE;
+}
+
+/*
+ * a2d_commit_remove:
+ *
+ * Removes the file and drops its pending contents or symlink. Returns TRUE
+ * when there was something to remove.
+ */
+gboolean
+a2d_commit_remove (A2DCommit *commit, const gchar *filename)
+{
+    gboolean pending;
+    guint ii;
+
+    g_mutex_lock (&commit->mutex);
+
+    pending = g_hash_table_remove (commit->pending, filename);
+    pending = g_hash_table_remove (commit->links, filename) || pending;
+
+    for (ii = 0; pending && ii < commit->order->len; ii++) {
+        if (strcmp (g_ptr_array_index (commit->order, ii), filename) == 0) {
+            g_ptr_array_remove_index (commit->order, ii);
+            break;
+        }
+    }
+
+    g_mutex_unlock (&commit->mutex);
+
+    return g_remove (filename) == 0 || pending;
+}
+
+/*
+ * a2d_commit_is_pending:
+ *
+ * Returns TRUE when the file was written in this commit, but it isn't on the
+ * disk yet.
+ */
+gboolean
+a2d_commit_is_pending (A2DCommit *commit, const gchar *filename)
+{
+    gboolean pending;
+
+    g_mutex_lock (&commit->mutex);
+    pending = g_hash_table_contains (commit->pending, filename) ||
+              g_hash_table_contains (commit->links, filename);
+    g_mutex_unlock (&commit->mutex);
+
+    return pending;
+}
+
+/*
+ * a2d_commit_finish:
+ *
+ * Commits pending files and frees the commit. Returns FALSE when some file
+ * couldn't be written.
+ */
+gboolean
+a2d_commit_finish (A2DCommit *commit)
+{
+    gboolean ret_val = TRUE;
+
+    if (g_hash_table_size (commit->pending) > 0 || g_hash_table_size (commit->links) > 0) {
+        gint64 commit_start = a2d_stats_get_time_ns ();
+
+        ret_val = commit_pending (commit);
+
+        a2d_stats_add (A2D_STAT_COMMIT_NSEC, a2d_stats_get_time_ns () - commit_start);
+    }
+
+    g_hash_table_destroy (commit->links);
+    g_ptr_array_free (commit->order, TRUE);
+    g_hash_table_destroy (commit->pending);
+    g_mutex_clear (&commit->mutex);
+    g_free (commit);
+
+    return ret_val;
+}
@@ -0,0 +1,62 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_COMMIT_H
+#define __A2D_COMMIT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	A2D_DURABILITY_INVALID,
+	A2D_DURABILITY_FSYNC,
+	A2D_DURABILITY_GROUP,
+	A2D_DURABILITY_NONE
+} A2DDurability;
+
+typedef struct A2DCommit A2DCommit;
+
+A2DDurability	a2d_durability_from_string		(const gchar *string);
+const gchar *	a2d_durability_to_string		(A2DDurability durability);
+
+A2DCommit *	a2d_commit_new				(A2DDurability durability);
+gboolean	a2d_commit_write			(A2DCommit *commit,
+							 const gchar *filename,
+							 const gchar *contents,
+							 gsize length);
+gboolean	a2d_commit_symlink			(A2DCommit *commit,
+							 const gchar *target,
+							 const gchar *filename);
+gboolean	a2d_commit_read				(A2DCommit *commit,
+							 const gchar *filename,
+							 gchar **contents,
+							 gsize *length);
+gboolean	a2d_commit_remove			(A2DCommit *commit,
+							 const gchar *filename);
+gboolean	a2d_commit_is_pending			(A2DCommit *commit,
+							 const gchar *filename);
+gboolean	a2d_commit_finish			(A2DCommit *commit);
+
+G_END_DECLS
+
+#endif /* __A2D_COMMIT_H */
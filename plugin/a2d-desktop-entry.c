@@ -0,0 +1,331 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <string.h>
+
+#include "a2d-desktop-entry.h"
+#include "a2d-stats.h"
+
+/* Output of the renderer, when data is NULL only the length is counted */
+typedef struct {
+    gchar		*data;
+    gsize		 length;
+} A2DBuffer;
+
+static void
+put (A2DBuffer *buffer, const gchar *string, gsize length)
+{
+    if (buffer->data)
+        memcpy (buffer->data + buffer->length, string, length);
+
+    buffer->length += length;
+}
+
+#define put_literal(buffer, literal) put ((buffer), (literal), sizeof (literal) - 1)
+
+/*
+ * put_escaped:
+ *
+ * Escapes value the same way as g_key_file_set_string does.
+ */
+static void
+put_escaped (A2DBuffer *buffer, const gchar *value)
+{
+    const gchar *position;
+    const gchar *run = value;
+
+    for (position = value; *position; position++) {
+        const gchar *escape;
+
+        switch (*position) {
+        case ' ':
+            escape = position == value ? "\\s" : NULL;
+            break;
+        case '\n':
+            escape = "\\n";
+            break;
+        case '\t':
+            escape = "\\t";
+            break;
+        case '\r':
+            escape = "\\r";
+            break;
+        case '\\':
+            escape = "\\\\";
+            break;
+        default:
+            escape = NULL;
+            break;
+        }
+
+        if (escape) {
+            put (buffer, run, position - run);
+            put (buffer, escape, 2);
+            run = position + 1;
+        }
+    }
+
+    put (buffer, run, position - run);
+}
+
+static void
+put_boolean (A2DBuffer *buffer, gboolean value)
+{
+    if (value)
+        put_literal (buffer, "true");
+    else
+        put_literal (buffer, "false");
+}
+
+/*
+ * render:
+ *
+ * Template of the generated .desktop file. Keys are in the order in which
+ * they were set to GKeyFile before. All values are escaped, so e.g. newline
+ * in the name of app can't start another key. Localized keys follow the
+ * others, the locales are sorted.
+ */
+static void
+render (A2DBuffer *buffer, const A2DDesktopEntry *entry)
+{
+    guint ii;
+
+    put_literal (buffer, "[Desktop Entry]\nType=Application\nName=");
+    put_escaped (buffer, entry->name);
+    put_literal (buffer, "\nExec=");
+    put_escaped (buffer, entry->exec);
+    put_literal (buffer, "\nStartupWMClass=");
+    put_escaped (buffer, entry->startup_wm_class);
+    put_literal (buffer, "\nCategories=NETWORK\nIcon=");
+    put_escaped (buffer, entry->icon);
+    put_literal (buffer, "\nTerminal=false\nX-Offline-Enabled=");
+    put_boolean (buffer, entry->offline_enabled);
+    put_literal (buffer, "\nHidden=");
+    put_boolean (buffer, entry->hidden);
+    put_literal (buffer, "\nX-App-Version=");
+    put_escaped (buffer, entry->app_version);
+    put_literal (buffer, "\n");
+
+    for (ii = 0; entry->localizations && ii < entry->localizations->len; ii++) {
+        A2DLocalization *localization = g_ptr_array_index (entry->localizations, ii);
+
+        if (localization->name) {
+            put_literal (buffer, "Name[");
+            put (buffer, localization->locale, strlen (localization->locale));
+            put_literal (buffer, "]=");
+            put_escaped (buffer, localization->name);
+            put_literal (buffer, "\n");
+        }
+
+        if (localization->comment) {
+            put_literal (buffer, "Comment[");
+            put (buffer, localization->locale, strlen (localization->locale));
+            put_literal (buffer, "]=");
+            put_escaped (buffer, localization->comment);
+            put_literal (buffer, "\n");
+        }
+    }
+}
+
+/*
+ * a2d_desktop_entry_render:
+ *
+ * Renders contents of the .desktop file. The length is computed first, so
+ * the output is written into one exactly sized buffer.
+ */
+gchar *
+a2d_desktop_entry_render (const A2DDesktopEntry *entry, gsize *length)
+{
+    A2DBuffer buffer = { NULL, 0 };
+    gint64 render_start = a2d_stats_get_time_ns ();
+
+    render (&buffer, entry);
+
+    buffer.data = g_malloc (buffer.length + 1);
+    buffer.length = 0;
+
+    render (&buffer, entry);
+    buffer.data[buffer.length] = '\0';
+
+    *length = buffer.length;
+
+    a2d_stats_add (A2D_STAT_DESKTOP_ENTRIES, 1);
+    a2d_stats_add (A2D_STAT_DESKTOP_ENTRY_NSEC, a2d_stats_get_time_ns () - render_start);
+
+    return buffer.data;
+}
+
+/*
+ * skip_blanks:
+ */
+static const gchar *
+skip_blanks (const gchar *position, const gchar *end)
+{
+    while (position < end && (*position == ' ' || *position == '\t'))
+        position++;
+
+    return position;
+}
+
+/*
+ * trim_end:
+ *
+ * Returns end of the line without trailing whitespace.
+ */
+static const gchar *
+trim_end (const gchar *start, const gchar *end)
+{
+    while (end > start && g_ascii_isspace (end[-1]))
+        end--;
+
+    return end;
+}
+
+/*
+ * parse_hidden_line:
+ *
+ * Checks whether the line (without leading blanks) sets the Hidden key and
+ * finds its value. Localized keys like Hidden[cs] don't match.
+ */
+static gboolean
+parse_hidden_line (const gchar *line, const gchar *line_end,
+                   const gchar **value, const gchar **value_end)
+{
+    const gchar *position;
+
+    if (line_end - line < (gssize) strlen (G_KEY_FILE_DESKTOP_KEY_HIDDEN) ||
+        memcmp (line, G_KEY_FILE_DESKTOP_KEY_HIDDEN, strlen (G_KEY_FILE_DESKTOP_KEY_HIDDEN)))
+        return FALSE;
+
+    position = skip_blanks (line + strlen (G_KEY_FILE_DESKTOP_KEY_HIDDEN), line_end);
+    if (position == line_end || *position != '=')
+        return FALSE;
+
+    *value = skip_blanks (position + 1, line_end);
+    *value_end = trim_end (*value, line_end);
+
+    return TRUE;
+}
+
+/*
+ * value_is:
+ */
+static gboolean
+value_is (const gchar *value, const gchar *value_end, const gchar *expected)
+{
+    gsize length = strlen (expected);
+
+    return (gsize) (value_end - value) == length && !memcmp (value, expected, length);
+}
+
+/*
+ * a2d_desktop_entry_patch_hidden:
+ *
+ * Sets the Hidden key of the [Desktop Entry] group without parsing the
+ * whole file. Only the line with the key is replaced, or a new line is
+ * added after the last key of the group when the key is missing. The rest
+ * of the contents, including translations and comments, is kept as it is.
+ *
+ * Returns A2D_DESKTOP_ENTRY_PATCH_UNCHANGED and leaves the patched contents
+ * unset when the key already has the requested value and
+ * A2D_DESKTOP_ENTRY_PATCH_FAILED when there is no [Desktop Entry] group.
+ */
+A2DDesktopEntryPatch
+a2d_desktop_entry_patch_hidden (const gchar *contents, gsize length, gboolean hidden,
+                                gchar **patched, gsize *patched_length)
+{
+    const gchar *end = contents + length;
+    const gchar *line = contents;
+    const gchar *replace_start = NULL, *replace_end = NULL;
+    const gchar *insert_at = NULL;
+    const gchar *new_value = hidden ? "true" : "false";
+    gboolean in_group = FALSE;
+    GString *string;
+
+    while (line < end) {
+        const gchar *line_end = memchr (line, '\n', end - line);
+        const gchar *next = line_end ? line_end + 1 : end;
+        const gchar *start, *value, *value_end;
+
+        if (!line_end)
+            line_end = end;
+
+        start = skip_blanks (line, line_end);
+
+        if (start < line_end && *start == '[') {
+            /* Keys of other groups are not interesting */
+            if (insert_at)
+                break;
+
+            in_group = value_is (start, trim_end (start, line_end),
+                                 "[" G_KEY_FILE_DESKTOP_GROUP "]");
+            if (in_group)
+                insert_at = next;
+        } else if (in_group && start < trim_end (start, line_end) && *start != '#') {
+            insert_at = next;
+
+            /* The last occurrence wins, the same as in GKeyFile */
+            if (parse_hidden_line (start, line_end, &value, &value_end)) {
+                gboolean same = value_is (value, value_end, new_value) ||
+                                value_is (value, value_end, hidden ? "1" : "0");
+
+                replace_start = same ? NULL : line;
+                replace_end = value_end;
+            }
+        }
+
+        line = next;
+    }
+
+    if (!insert_at)
+        return A2D_DESKTOP_ENTRY_PATCH_FAILED;
+
+    if (replace_end && !replace_start)
+        return A2D_DESKTOP_ENTRY_PATCH_UNCHANGED;
+
+    /* Missing key means that the entry is not hidden */
+    if (!replace_end && !hidden)
+        return A2D_DESKTOP_ENTRY_PATCH_UNCHANGED;
+
+    string = g_string_sized_new (length + strlen ("\nHidden=false\n"));
+
+    if (replace_start) {
+        g_string_append_len (string, contents, replace_start - contents);
+        g_string_append (string, G_KEY_FILE_DESKTOP_KEY_HIDDEN "=");
+        g_string_append (string, new_value);
+        g_string_append_len (string, replace_end, end - replace_end);
+    } else {
+        g_string_append_len (string, contents, insert_at - contents);
+        if (insert_at > contents && insert_at[-1] != '\n')
+            g_string_append_c (string, '\n');
+        g_string_append (string, G_KEY_FILE_DESKTOP_KEY_HIDDEN "=");
+        g_string_append (string, new_value);
+        g_string_append_c (string, '\n');
+        g_string_append_len (string, insert_at, end - insert_at);
+    }
+
+    *patched_length = string->len;
+    *patched = g_string_free (string, FALSE);
+
+    return A2D_DESKTOP_ENTRY_PATCH_CHANGED;
+}
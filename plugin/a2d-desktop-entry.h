@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_DESKTOP_ENTRY_H
+#define __A2D_DESKTOP_ENTRY_H
+
+#include <glib.h>
+
+#include "a2d-locale.h"
+
+G_BEGIN_DECLS
+
+/* Values of the .desktop file generated for app */
+typedef struct {
+	const gchar	*name;
+	const gchar	*exec;
+	const gchar	*startup_wm_class;
+	const gchar	*icon;
+	gboolean	 offline_enabled;
+	gboolean	 hidden;
+	const gchar	*app_version;
+	GPtrArray	*localizations;		/* A2DLocalization, may be NULL */
+} A2DDesktopEntry;
+
+typedef enum {
+	A2D_DESKTOP_ENTRY_PATCH_FAILED,
+	A2D_DESKTOP_ENTRY_PATCH_UNCHANGED,
+	A2D_DESKTOP_ENTRY_PATCH_CHANGED
+} A2DDesktopEntryPatch;
+
+gchar *		a2d_desktop_entry_render		(const A2DDesktopEntry *entry,
+							 gsize *length);
+A2DDesktopEntryPatch
+		a2d_desktop_entry_patch_hidden		(const gchar *contents,
+							 gsize length,
+							 gboolean hidden,
+							 gchar **patched,
+							 gsize *patched_length);
+
+G_END_DECLS
+
+#endif /* __A2D_DESKTOP_ENTRY_H */
@@ -0,0 +1,280 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a2d-desktop-scan.h"
+
+#define DESKTOP_ENTRY_GROUP "[Desktop Entry]"
+#define EXEC_KEY "Exec"
+#define XDG_OPEN "xdg-open"
+#define READ_BUFFER_SIZE 4096
+#define FILES_PER_THREAD 32
+
+typedef struct {
+    int fd;
+    gsize start;
+    gsize end;
+    gboolean eof;
+    gchar buffer[READ_BUFFER_SIZE];
+} A2DLineReader;
+
+typedef struct {
+    const gchar *directory;
+    GPtrArray *names;
+    const gchar *executable;
+    A2DDesktopScanResult *results;
+} A2DScanJob;
+
+typedef struct {
+    A2DScanJob *job;
+    guint first;
+    guint last;
+} A2DScanSlice;
+
+/*
+ * line_reader_next:
+ *
+ * Returns next line of the file without the line terminator. Data is read in
+ * small chunks, so only the beginning of the file is read when the caller stops
+ * early. Lines longer than the buffer are split.
+ */
+static gboolean
+line_reader_next (A2DLineReader *reader, const gchar **line, gsize *length)
+{
+    for (;;) {
+        gchar *start = reader->buffer + reader->start;
+        gchar *newline = memchr (start, '\n', reader->end - reader->start);
+        gssize bytes_read;
+
+        if (newline) {
+            *line = start;
+            *length = newline - start;
+            reader->start += *length + 1;
+
+            return TRUE;
+        }
+
+        if (reader->eof || reader->end - reader->start == sizeof (reader->buffer)) {
+            if (reader->start == reader->end)
+                return FALSE;
+
+            *line = start;
+            *length = reader->end - reader->start;
+            reader->start = reader->end;
+
+            return TRUE;
+        }
+
+        if (reader->start > 0) {
+            memmove (reader->buffer, start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+
+        do {
+            bytes_read = read (reader->fd, reader->buffer + reader->end,
+                               sizeof (reader->buffer) - reader->end);
+        } while (bytes_read < 0 && errno == EINTR);
+
+        if (bytes_read <= 0)
+            reader->eof = TRUE;
+        else
+            reader->end += bytes_read;
+    }
+}
+
+/*
+ * strip_line:
+ *
+ * Drops trailing carriage return and whitespace from the line.
+ */
+static gsize
+strip_line (const gchar *line, gsize length)
+{
+    while (length > 0 && g_ascii_isspace (line[length - 1]))
+        length--;
+
+    return length;
+}
+
+/*
+ * get_exec_value:
+ *
+ * Returns value of the Exec key if the line sets it, NULL otherwise. Localized
+ * variants (Exec[xx]) do not exist in the specification and are not matched.
+ */
+static const gchar *
+get_exec_value (const gchar *line, gsize length, gsize *value_length)
+{
+    gsize ii = strlen (EXEC_KEY);
+
+    if (length < ii || memcmp (line, EXEC_KEY, ii) != 0)
+        return NULL;
+
+    while (ii < length && (line[ii] == ' ' || line[ii] == '\t'))
+        ii++;
+
+    if (ii == length || line[ii] != '=')
+        return NULL;
+
+    *value_length = length - ii - 1;
+
+    return line + ii + 1;
+}
+
+/*
+ * a2d_desktop_scan_file:
+ *
+ * Classifies desktop file by the command in its Exec key. Only the file up to
+ * the Exec key of the [Desktop Entry] group is read.
+ */
+A2DDesktopScanResult
+a2d_desktop_scan_file (const gchar *path, const gchar *executable)
+{
+    A2DLineReader reader;
+    A2DDesktopScanResult result = A2D_DESKTOP_SCAN_OTHER;
+    gboolean in_desktop_entry = FALSE;
+    gsize executable_length = strlen (executable);
+    const gchar *line;
+    gsize length;
+
+    reader.fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (reader.fd < 0)
+        return A2D_DESKTOP_SCAN_UNREADABLE;
+
+    reader.start = reader.end = 0;
+    reader.eof = FALSE;
+
+    while (line_reader_next (&reader, &line, &length)) {
+        const gchar *value;
+        gsize value_length;
+
+        length = strip_line (line, length);
+
+        if (length > 0 && line[0] == '[') {
+            /* Exec is looked up only in the main group */
+            if (in_desktop_entry)
+                break;
+
+            in_desktop_entry = length == strlen (DESKTOP_ENTRY_GROUP) &&
+                memcmp (line, DESKTOP_ENTRY_GROUP, length) == 0;
+
+            continue;
+        }
+
+        if (!in_desktop_entry)
+            continue;
+
+        value = get_exec_value (line, length, &value_length);
+        if (!value)
+            continue;
+
+        if (memmem (value, value_length, XDG_OPEN, strlen (XDG_OPEN)))
+            result = A2D_DESKTOP_SCAN_XDG_OPEN;
+        else if (executable_length > 0 &&
+                 memmem (value, value_length, executable, executable_length))
+            result = A2D_DESKTOP_SCAN_EXECUTABLE;
+
+        break;
+    }
+
+    close (reader.fd);
+
+    return result;
+}
+
+static void
+scan_slice (gpointer data, gpointer user_data)
+{
+    A2DScanSlice *slice = data;
+    A2DScanJob *job = slice->job;
+    guint ii;
+
+    for (ii = slice->first; ii < slice->last; ii++) {
+        gchar *path = g_build_filename (
+            job->directory, g_ptr_array_index (job->names, ii), NULL);
+
+        job->results[ii] = a2d_desktop_scan_file (path, job->executable);
+
+        g_free (path);
+    }
+
+    g_free (slice);
+}
+
+/*
+ * a2d_desktop_scan_files:
+ *
+ * Classifies all named desktop files in the directory. Large directories are
+ * split between the processors. Results are stored at the index of the name,
+ * so the caller sees the same outcome regardless of the scheduling. Returned
+ * array should be freed with g_free.
+ */
+A2DDesktopScanResult *
+a2d_desktop_scan_files (const gchar *directory, GPtrArray *names, const gchar *executable)
+{
+    A2DScanJob job;
+    GThreadPool *pool = NULL;
+    guint n_threads;
+    guint slice_size;
+    guint ii;
+
+    job.directory = directory;
+    job.names = names;
+    job.executable = executable;
+    job.results = g_new0 (A2DDesktopScanResult, MAX (names->len, 1));
+
+    n_threads = MIN (g_get_num_processors (),
+                     (names->len + FILES_PER_THREAD - 1) / FILES_PER_THREAD);
+
+    if (n_threads > 1)
+        pool = g_thread_pool_new (scan_slice, NULL, n_threads, TRUE, NULL);
+
+    if (!pool)
+        n_threads = 1;
+
+    slice_size = (names->len + n_threads - 1) / n_threads;
+
+    for (ii = 0; ii < names->len; ii += slice_size) {
+        A2DScanSlice *slice = g_new (A2DScanSlice, 1);
+
+        slice->job = &job;
+        slice->first = ii;
+        slice->last = MIN (ii + slice_size, names->len);
+
+        if (!pool || !g_thread_pool_push (pool, slice, NULL))
+            scan_slice (slice, NULL);
+    }
+
+    /* Waits for all slices to finish */
+    if (pool)
+        g_thread_pool_free (pool, FALSE, TRUE);
+
+    return job.results;
+}
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_DESKTOP_SCAN_H
+#define __A2D_DESKTOP_SCAN_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	A2D_DESKTOP_SCAN_UNREADABLE,
+	A2D_DESKTOP_SCAN_OTHER,
+	A2D_DESKTOP_SCAN_XDG_OPEN,
+	A2D_DESKTOP_SCAN_EXECUTABLE
+} A2DDesktopScanResult;
+
+A2DDesktopScanResult	a2d_desktop_scan_file		(const gchar *path,
+							 const gchar *executable);
+A2DDesktopScanResult *	a2d_desktop_scan_files		(const gchar *directory,
+							 GPtrArray *names,
+							 const gchar *executable);
+
+G_END_DECLS
+
+#endif /* __A2D_DESKTOP_SCAN_H */
@@ -0,0 +1,247 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/inotify.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a2d-dir-index.h"
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*
+ * Names of files in a directory. The index is built once and then it is
+ * updated from inotify events, which are read before every query. Without
+ * inotify the directory is rescanned when its modification time changes.
+ */
+struct A2DDirIndex
+{
+    GMutex		 mutex;
+    gchar		*path;
+    GHashTable		*names;
+    gint		 inotify_fd;
+    gint		 watch;
+    gboolean		 valid;
+    gint64		 mtime;
+};
+
+/*
+ * dir_index_rescan:
+ *
+ * Reads all names from the directory.
+ */
+static void
+dir_index_rescan (A2DDirIndex *dir_index)
+{
+    GDir *dir;
+    GStatBuf stat_buf;
+    const gchar *name;
+
+    g_hash_table_remove_all (dir_index->names);
+
+    if (dir_index->inotify_fd >= 0) {
+        if (dir_index->watch >= 0)
+            inotify_rm_watch (dir_index->inotify_fd, dir_index->watch);
+
+        dir_index->watch = inotify_add_watch (dir_index->inotify_fd,
+                                              dir_index->path,
+                                              WATCH_MASK);
+    }
+
+    if (!g_stat (dir_index->path, &stat_buf))
+        dir_index->mtime = stat_buf.st_mtime;
+
+    dir_index->valid = TRUE;
+
+    dir = g_dir_open (dir_index->path, 0, NULL);
+    if (!dir)
+        return;
+
+    while ((name = g_dir_read_name (dir)))
+        g_hash_table_add (dir_index->names, g_strdup (name));
+
+    g_dir_close (dir);
+}
+
+/*
+ * dir_index_process_events:
+ *
+ * Applies pending inotify events to the index.
+ */
+static void
+dir_index_process_events (A2DDirIndex *dir_index)
+{
+    gchar buffer[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    gssize length;
+
+    while ((length = read (dir_index->inotify_fd, buffer, sizeof (buffer))) > 0) {
+        gchar *position = buffer;
+
+        while (position < buffer + length) {
+            struct inotify_event *event = (struct inotify_event *) position;
+
+            position += sizeof (struct inotify_event) + event->len;
+
+            /* Events were lost */
+            if (event->mask & IN_Q_OVERFLOW) {
+                dir_index->valid = FALSE;
+                continue;
+            }
+
+            /* Events of the watch removed by rescan */
+            if (event->wd != dir_index->watch)
+                continue;
+
+            /* Directory itself was removed or moved */
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                dir_index->valid = FALSE;
+                continue;
+            }
+
+            if (!event->len)
+                continue;
+
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                g_hash_table_add (dir_index->names, g_strdup (event->name));
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                g_hash_table_remove (dir_index->names, event->name);
+        }
+    }
+}
+
+/*
+ * dir_index_update:
+ *
+ * Brings the index up to date.
+ */
+static void
+dir_index_update (A2DDirIndex *dir_index)
+{
+    if (dir_index->inotify_fd >= 0) {
+        dir_index_process_events (dir_index);
+
+        /* Directory didn't exist or it was replaced */
+        if (dir_index->watch < 0)
+            dir_index->valid = FALSE;
+    } else {
+        GStatBuf stat_buf;
+
+        if (g_stat (dir_index->path, &stat_buf) || stat_buf.st_mtime != dir_index->mtime)
+            dir_index->valid = FALSE;
+    }
+
+    if (!dir_index->valid)
+        dir_index_rescan (dir_index);
+}
+
+static gint
+compare_names (gconstpointer a, gconstpointer b)
+{
+    return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+/*
+ * a2d_dir_index_new:
+ *
+ * Creates index of the directory with given path.
+ */
+A2DDirIndex *
+a2d_dir_index_new (const gchar *path)
+{
+    A2DDirIndex *dir_index = g_new0 (A2DDirIndex, 1);
+
+    g_mutex_init (&dir_index->mutex);
+    dir_index->path = g_strdup (path);
+    dir_index->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    dir_index->inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    dir_index->watch = -1;
+
+    dir_index_rescan (dir_index);
+
+    return dir_index;
+}
+
+/*
+ * a2d_dir_index_free:
+ */
+void
+a2d_dir_index_free (A2DDirIndex *dir_index)
+{
+    if (!dir_index)
+        return;
+
+    if (dir_index->inotify_fd >= 0)
+        close (dir_index->inotify_fd);
+
+    g_hash_table_destroy (dir_index->names);
+    g_free (dir_index->path);
+    g_mutex_clear (&dir_index->mutex);
+    g_free (dir_index);
+}
+
+/*
+ * a2d_dir_index_contains:
+ *
+ * Returns TRUE when the file with given name is in the directory.
+ */
+gboolean
+a2d_dir_index_contains (A2DDirIndex *dir_index, const gchar *name)
+{
+    gboolean ret_val;
+
+    g_mutex_lock (&dir_index->mutex);
+    dir_index_update (dir_index);
+    ret_val = g_hash_table_contains (dir_index->names, name);
+    g_mutex_unlock (&dir_index->mutex);
+
+    return ret_val;
+}
+
+/*
+ * a2d_dir_index_get_names:
+ *
+ * Returns sorted array with copies of all names in the directory.
+ */
+GPtrArray *
+a2d_dir_index_get_names (A2DDirIndex *dir_index)
+{
+    GPtrArray *names;
+    GHashTableIter iter;
+    gpointer name;
+
+    g_mutex_lock (&dir_index->mutex);
+    dir_index_update (dir_index);
+
+    names = g_ptr_array_new_with_free_func (g_free);
+    g_hash_table_iter_init (&iter, dir_index->names);
+    while (g_hash_table_iter_next (&iter, &name, NULL))
+        g_ptr_array_add (names, g_strdup (name));
+
+    g_mutex_unlock (&dir_index->mutex);
+
+    g_ptr_array_sort (names, (GCompareFunc) compare_names);
+
+    return names;
+}
@@ -0,0 +1,352 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <sys/inotify.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a2d-extension-resolver.h"
+#include "a2d-stats.h"
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*
+ * Resolves app id to the directory of the installed extension version. The
+ * Extensions directory and the directories of the resolved ids are watched by
+ * inotify, a resolved path is kept until an event touches its app. Without
+ * inotify nothing is cached.
+ */
+struct A2DExtensionResolver
+{
+    GMutex		 mutex;
+    gchar		*path;
+    GHashTable		*paths;		/* app id -> path, "" when not installed */
+    GHashTable		*watches;	/* watch -> app id */
+    gint		 inotify_fd;
+    gint		 watch;
+};
+
+/*
+ * parse_version:
+ *
+ * Splits extension directory name "1.2.3_0" to the dotted version and the
+ * suffix Chrome appends to the reinstalled versions. Returns FALSE when the
+ * name isn't a version.
+ */
+static gboolean
+parse_version (const gchar *name, guint64 *components, guint *n_components, guint64 *suffix)
+{
+    const gchar *position = name;
+
+    *n_components = 0;
+    *suffix = 0;
+
+    for (;;) {
+        gchar *end;
+
+        if (!g_ascii_isdigit (*position) || *n_components == 8)
+            return FALSE;
+
+        components[(*n_components)++] = g_ascii_strtoull (position, &end, 10);
+        position = end;
+
+        if (*position != '.')
+            break;
+
+        position++;
+    }
+
+    if (*position == '_') {
+        gchar *end;
+
+        if (!g_ascii_isdigit (position[1]))
+            return FALSE;
+
+        *suffix = g_ascii_strtoull (position + 1, &end, 10);
+        position = end;
+    }
+
+    return *position == '\0';
+}
+
+/*
+ * a2d_extension_version_compare:
+ *
+ * Compares extension directory names by Chrome's version ordering, missing
+ * components count as zero. Names that aren't versions sort first.
+ */
+gint
+a2d_extension_version_compare (const gchar *a, const gchar *b)
+{
+    guint64 components_a[8], components_b[8];
+    guint n_components_a, n_components_b;
+    guint64 suffix_a, suffix_b;
+    gboolean valid_a, valid_b;
+    guint ii;
+
+    valid_a = parse_version (a, components_a, &n_components_a, &suffix_a);
+    valid_b = parse_version (b, components_b, &n_components_b, &suffix_b);
+
+    if (!valid_a || !valid_b)
+        return valid_a - valid_b;
+
+    for (ii = 0; ii < MAX (n_components_a, n_components_b); ii++) {
+        guint64 component_a = ii < n_components_a ? components_a[ii] : 0;
+        guint64 component_b = ii < n_components_b ? components_b[ii] : 0;
+
+        if (component_a != component_b)
+            return component_a < component_b ? -1 : 1;
+    }
+
+    if (suffix_a != suffix_b)
+        return suffix_a < suffix_b ? -1 : 1;
+
+    return 0;
+}
+
+/*
+ * resolver_forget:
+ *
+ * Drops cached path of the app and stops watching its directory.
+ */
+static void
+resolver_forget (A2DExtensionResolver *resolver, const gchar *app_id)
+{
+    GHashTableIter iter;
+    gpointer watch, watched_app_id;
+
+    g_hash_table_iter_init (&iter, resolver->watches);
+    while (g_hash_table_iter_next (&iter, &watch, &watched_app_id)) {
+        if (strcmp (watched_app_id, app_id) == 0) {
+            inotify_rm_watch (resolver->inotify_fd, GPOINTER_TO_INT (watch));
+            g_hash_table_iter_remove (&iter);
+            break;
+        }
+    }
+
+    g_hash_table_remove (resolver->paths, app_id);
+}
+
+/*
+ * resolver_forget_all:
+ */
+static void
+resolver_forget_all (A2DExtensionResolver *resolver)
+{
+    GHashTableIter iter;
+    gpointer watch;
+
+    g_hash_table_iter_init (&iter, resolver->watches);
+    while (g_hash_table_iter_next (&iter, &watch, NULL))
+        inotify_rm_watch (resolver->inotify_fd, GPOINTER_TO_INT (watch));
+
+    g_hash_table_remove_all (resolver->watches);
+    g_hash_table_remove_all (resolver->paths);
+
+    if (resolver->watch >= 0)
+        inotify_rm_watch (resolver->inotify_fd, resolver->watch);
+
+    resolver->watch = -1;
+}
+
+/*
+ * resolver_process_events:
+ *
+ * Drops cached paths touched by pending inotify events.
+ */
+static void
+resolver_process_events (A2DExtensionResolver *resolver)
+{
+    gchar buffer[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    gssize length;
+
+    while ((length = read (resolver->inotify_fd, buffer, sizeof (buffer))) > 0) {
+        gchar *position = buffer;
+
+        while (position < buffer + length) {
+            struct inotify_event *event = (struct inotify_event *) position;
+            const gchar *app_id;
+
+            position += sizeof (struct inotify_event) + event->len;
+
+            /* Events were lost */
+            if (event->mask & IN_Q_OVERFLOW) {
+                resolver_forget_all (resolver);
+                continue;
+            }
+
+            if (event->wd == resolver->watch) {
+                if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+                    resolver_forget_all (resolver);
+                else if (event->len)
+                    resolver_forget (resolver, event->name);
+
+                continue;
+            }
+
+            /* Events of the removed watches are ignored */
+            app_id = g_hash_table_lookup (resolver->watches, GINT_TO_POINTER (event->wd));
+            if (app_id)
+                resolver_forget (resolver, app_id);
+        }
+    }
+}
+
+/*
+ * resolve:
+ *
+ * Finds the directory of the highest version of the extension, when the
+ * directory doesn't contain any version the first entry is used.
+ */
+static gchar *
+resolve (A2DExtensionResolver *resolver, const gchar *app_id)
+{
+    GDir *dir;
+    gchar *extension_root;
+    gchar *extension_path = NULL;
+    const gchar *name;
+    gchar *best = NULL;
+
+    extension_root = g_build_filename (resolver->path, app_id, NULL);
+
+    dir = g_dir_open (extension_root, 0, NULL);
+    if (dir) {
+        while ((name = g_dir_read_name (dir))) {
+            if (!best || a2d_extension_version_compare (name, best) > 0) {
+                g_free (best);
+                best = g_strdup (name);
+            }
+        }
+
+        g_dir_close (dir);
+    }
+
+    if (best)
+        extension_path = g_strconcat (extension_root, "/", best, "/", NULL);
+
+    a2d_stats_add (A2D_STAT_EXTENSION_SCANS, 1);
+
+    g_free (best);
+    g_free (extension_root);
+
+    return extension_path;
+}
+
+/*
+ * a2d_extension_resolver_new:
+ *
+ * Creates resolver for extensions installed in the given directory.
+ */
+A2DExtensionResolver *
+a2d_extension_resolver_new (const gchar *extensions_path)
+{
+    A2DExtensionResolver *resolver = g_new0 (A2DExtensionResolver, 1);
+
+    g_mutex_init (&resolver->mutex);
+    resolver->path = g_strdup (extensions_path);
+    resolver->paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    resolver->watches = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    resolver->inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    resolver->watch = -1;
+
+    return resolver;
+}
+
+/*
+ * a2d_extension_resolver_free:
+ */
+void
+a2d_extension_resolver_free (A2DExtensionResolver *resolver)
+{
+    if (!resolver)
+        return;
+
+    if (resolver->inotify_fd >= 0)
+        close (resolver->inotify_fd);
+
+    g_hash_table_destroy (resolver->watches);
+    g_hash_table_destroy (resolver->paths);
+    g_free (resolver->path);
+    g_mutex_clear (&resolver->mutex);
+    g_free (resolver);
+}
+
+/*
+ * a2d_extension_resolver_get_path:
+ *
+ * Returns path to the directory of the installed extension version ending with
+ * slash or NULL when the extension isn't installed. Returned string should be
+ * freed with g_free.
+ */
+gchar *
+a2d_extension_resolver_get_path (A2DExtensionResolver *resolver, const gchar *app_id)
+{
+    gchar *extension_path;
+    gchar *app_path;
+    gint watch;
+
+    a2d_stats_add (A2D_STAT_EXTENSION_LOOKUPS, 1);
+
+    g_mutex_lock (&resolver->mutex);
+
+    if (resolver->inotify_fd < 0) {
+        extension_path = resolve (resolver, app_id);
+        goto out;
+    }
+
+    resolver_process_events (resolver);
+
+    if (resolver->watch < 0)
+        resolver->watch = inotify_add_watch (resolver->inotify_fd, resolver->path, WATCH_MASK);
+
+    extension_path = g_hash_table_lookup (resolver->paths, app_id);
+    if (extension_path) {
+        extension_path = *extension_path ? g_strdup (extension_path) : NULL;
+        goto out;
+    }
+
+    /* The watch is added first, so changes made during resolving are noticed */
+    app_path = g_build_filename (resolver->path, app_id, NULL);
+    watch = inotify_add_watch (resolver->inotify_fd, app_path, WATCH_MASK);
+    g_free (app_path);
+
+    extension_path = resolve (resolver, app_id);
+
+    /* Results can be cached only while both directories are watched. The
+     * missing app directory is noticed through the Extensions directory. */
+    if (resolver->watch >= 0 && (watch >= 0 || !extension_path)) {
+        if (watch >= 0)
+            g_hash_table_insert (resolver->watches, GINT_TO_POINTER (watch), g_strdup (app_id));
+
+        g_hash_table_insert (resolver->paths, g_strdup (app_id),
+                             g_strdup (extension_path ? extension_path : ""));
+    } else if (watch >= 0) {
+        inotify_rm_watch (resolver->inotify_fd, watch);
+    }
+
+ out:
+    g_mutex_unlock (&resolver->mutex);
+
+    return extension_path;
+}
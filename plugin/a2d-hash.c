@@ -0,0 +1,62 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <string.h>
+
+#include "a2d-hash.h"
+
+#define FNV_PRIME G_GUINT64_CONSTANT (0x100000001b3)
+
+/*
+ * a2d_hash_data:
+ *
+ * Continues 64-bit FNV-1a hash (started with A2D_HASH_INIT) with data.
+ */
+guint64
+a2d_hash_data (guint64 hash, gconstpointer data, gsize length)
+{
+    const guchar *bytes = data;
+    gsize ii;
+
+    for (ii = 0; ii < length; ii++) {
+        hash ^= bytes[ii];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * a2d_hash_string:
+ *
+ * Continues hash with string including its terminating zero, so the
+ * sequences of strings are hashed unambiguously.
+ */
+guint64
+a2d_hash_string (guint64 hash, const gchar *string)
+{
+    if (!string)
+        string = "";
+
+    return a2d_hash_data (hash, string, strlen (string) + 1);
+}
@@ -0,0 +1,40 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_HASH_H
+#define __A2D_HASH_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define A2D_HASH_INIT G_GUINT64_CONSTANT (0xcbf29ce484222325)
+
+guint64		a2d_hash_data				(guint64 hash,
+							 gconstpointer data,
+							 gsize length);
+guint64		a2d_hash_string				(guint64 hash,
+							 const gchar *string);
+
+G_END_DECLS
+
+#endif /* __A2D_HASH_H */
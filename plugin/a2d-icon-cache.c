@@ -0,0 +1,553 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <utime.h>
+
+#include "a2d-icon-cache.h"
+#include "a2d-stats.h"
+
+#define CACHE_FILE "icon-theme.cache"
+#define CACHE_MAJOR_VERSION 1
+#define CACHE_MINOR_VERSION 0
+#define NO_OFFSET 0xffffffff
+
+/* Icon flags as defined by GTK */
+#define HAS_SUFFIX_XPM (1 << 0)
+#define HAS_SUFFIX_SVG (1 << 1)
+#define HAS_SUFFIX_PNG (1 << 2)
+#define HAS_ICON_FILE  (1 << 3)
+
+/* Icon directories are e.g. 48x48/apps, deeper directories are not used by
+ * themes */
+#define MAX_DEPTH 3
+
+/*
+ * Contents of one directory of the theme.
+ */
+typedef struct
+{
+    gint64		 mtime;
+    GPtrArray		*subdirectories;	/* names */
+    GHashTable		*icons;			/* name -> flags */
+    gboolean		 visited;
+} A2DIconDirectory;
+
+/*
+ * Model of the icon theme directory, which is used to write GTK's
+ * icon-theme.cache. Directories are rescanned only when they were changed by
+ * us or their modification time changed.
+ */
+struct A2DIconCache
+{
+    gchar		*theme_directory;
+    GHashTable		*directories;		/* relative path -> A2DIconDirectory */
+};
+
+typedef struct
+{
+    guint16		 directory;
+    guint16		 flags;
+} A2DIconImage;
+
+static void
+icon_directory_free (gpointer data)
+{
+    A2DIconDirectory *directory = data;
+
+    g_ptr_array_free (directory->subdirectories, TRUE);
+    g_hash_table_destroy (directory->icons);
+    g_free (directory);
+}
+
+static gint64
+get_mtime_ns (const GStatBuf *stat_buf)
+{
+    return (gint64) stat_buf->st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) +
+        stat_buf->st_mtim.tv_nsec;
+}
+
+/*
+ * get_icon_flags:
+ *
+ * Returns flag for the icon file by its suffix and strips the suffix.
+ */
+static guint
+get_icon_flags (gchar *name)
+{
+    gchar *suffix = strrchr (name, '.');
+    guint flags = 0;
+
+    if (!suffix || suffix == name)
+        return 0;
+
+    if (strcmp (suffix, ".png") == 0)
+        flags = HAS_SUFFIX_PNG;
+    else if (strcmp (suffix, ".svg") == 0)
+        flags = HAS_SUFFIX_SVG;
+    else if (strcmp (suffix, ".xpm") == 0)
+        flags = HAS_SUFFIX_XPM;
+    else if (strcmp (suffix, ".icon") == 0)
+        flags = HAS_ICON_FILE;
+
+    if (flags)
+        *suffix = '\0';
+
+    return flags;
+}
+
+/*
+ * scan_directory:
+ *
+ * Reads icons and subdirectories of the directory.
+ */
+static void
+scan_directory (A2DIconDirectory *directory, const gchar *path, gint depth)
+{
+    GDir *dir;
+    const gchar *name;
+
+    g_ptr_array_set_size (directory->subdirectories, 0);
+    g_hash_table_remove_all (directory->icons);
+
+    dir = g_dir_open (path, 0, NULL);
+    if (!dir)
+        return;
+
+    while ((name = g_dir_read_name (dir))) {
+        gchar *child_path = g_build_filename (path, name, NULL);
+
+        if (g_file_test (child_path, G_FILE_TEST_IS_DIR)) {
+            if (depth < MAX_DEPTH)
+                g_ptr_array_add (directory->subdirectories, g_strdup (name));
+        } else if (depth > 0) {
+            gchar *icon_name = g_strdup (name);
+            guint flags = get_icon_flags (icon_name);
+
+            if (flags) {
+                flags |= GPOINTER_TO_UINT (g_hash_table_lookup (directory->icons, icon_name));
+                g_hash_table_insert (directory->icons, icon_name, GUINT_TO_POINTER (flags));
+            } else
+                g_free (icon_name);
+        }
+
+        g_free (child_path);
+    }
+
+    g_dir_close (dir);
+
+    a2d_stats_add (A2D_STAT_ICON_CACHE_SCANS, 1);
+}
+
+/*
+ * is_changed:
+ *
+ * Checks if the directory is in the size directory changed by us.
+ */
+static gboolean
+is_changed (GHashTable *changed_directories, const gchar *relative_path)
+{
+    const gchar *slash = strchr (relative_path, '/');
+    gchar *size_directory;
+    gboolean ret_val;
+
+    if (!*relative_path || !changed_directories)
+        return FALSE;
+
+    size_directory = slash ? g_strndup (relative_path, slash - relative_path)
+                           : g_strdup (relative_path);
+    ret_val = g_hash_table_contains (changed_directories, size_directory);
+    g_free (size_directory);
+
+    return ret_val;
+}
+
+/*
+ * refresh_directory:
+ *
+ * Brings model of the directory and its subdirectories up to date. Returns
+ * TRUE when something changed.
+ */
+static gboolean
+refresh_directory (A2DIconCache *icon_cache, const gchar *relative_path,
+                   GHashTable *changed_directories, gint depth)
+{
+    A2DIconDirectory *directory;
+    GStatBuf stat_buf;
+    gboolean changed = FALSE;
+    gchar *path = g_build_filename (icon_cache->theme_directory, relative_path, NULL);
+    guint ii;
+
+    if (g_stat (path, &stat_buf) || !S_ISDIR (stat_buf.st_mode)) {
+        g_free (path);
+
+        return FALSE;
+    }
+
+    directory = g_hash_table_lookup (icon_cache->directories, relative_path);
+    if (!directory) {
+        directory = g_new0 (A2DIconDirectory, 1);
+        directory->subdirectories = g_ptr_array_new_with_free_func (g_free);
+        directory->icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        directory->mtime = -1;
+
+        g_hash_table_insert (icon_cache->directories, g_strdup (relative_path), directory);
+    }
+
+    directory->visited = TRUE;
+
+    if (directory->mtime != get_mtime_ns (&stat_buf) ||
+        is_changed (changed_directories, relative_path)) {
+        directory->mtime = get_mtime_ns (&stat_buf);
+        scan_directory (directory, path, depth);
+        changed = TRUE;
+    }
+
+    g_free (path);
+
+    for (ii = 0; ii < directory->subdirectories->len; ii++) {
+        const gchar *name = g_ptr_array_index (directory->subdirectories, ii);
+        gchar *child = *relative_path ? g_strconcat (relative_path, "/", name, NULL)
+                                      : g_strdup (name);
+
+        if (refresh_directory (icon_cache, child, changed_directories, depth + 1))
+            changed = TRUE;
+
+        g_free (child);
+    }
+
+    return changed;
+}
+
+/*
+ * refresh:
+ *
+ * Updates the model and drops directories which disappeared.
+ */
+static gboolean
+refresh (A2DIconCache *icon_cache, GHashTable *changed_directories)
+{
+    GHashTableIter iter;
+    gpointer value;
+    gboolean changed;
+
+    g_hash_table_iter_init (&iter, icon_cache->directories);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        ((A2DIconDirectory *) value)->visited = FALSE;
+
+    changed = refresh_directory (icon_cache, "", changed_directories, 0);
+
+    g_hash_table_iter_init (&iter, icon_cache->directories);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        if (!((A2DIconDirectory *) value)->visited) {
+            g_hash_table_iter_remove (&iter);
+            changed = TRUE;
+        }
+    }
+
+    return changed;
+}
+
+static void
+append_card16 (GByteArray *data, guint16 value)
+{
+    value = GUINT16_TO_BE (value);
+    g_byte_array_append (data, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+append_card32 (GByteArray *data, guint32 value)
+{
+    value = GUINT32_TO_BE (value);
+    g_byte_array_append (data, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+set_card32 (GByteArray *data, guint offset, guint32 value)
+{
+    value = GUINT32_TO_BE (value);
+    memcpy (data->data + offset, &value, sizeof (value));
+}
+
+/*
+ * append_string:
+ *
+ * Appends zero terminated string padded to four bytes, so the following
+ * numbers stay aligned.
+ */
+static guint32
+append_string (GByteArray *data, const gchar *string)
+{
+    static const guint8 padding[4] = { 0 };
+    guint32 offset = data->len;
+    gsize length = strlen (string) + 1;
+
+    g_byte_array_append (data, (const guint8 *) string, length);
+    g_byte_array_append (data, padding, (4 - length % 4) % 4);
+
+    return offset;
+}
+
+/*
+ * icon_name_hash:
+ *
+ * Hash function GTK uses to look up the icons in the cache.
+ */
+static guint32
+icon_name_hash (const gchar *name)
+{
+    const signed char *position = (const signed char *) name;
+    guint32 hash = *position;
+
+    if (hash)
+        for (position += 1; *position != '\0'; position++)
+            hash = (hash << 5) - hash + *position;
+
+    return hash;
+}
+
+static gint
+compare_strings (gconstpointer a, gconstpointer b)
+{
+    return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+/*
+ * build_cache:
+ *
+ * Serializes the model in the icon-theme.cache format 1.0: header, hash
+ * table of icons with their image lists and the list of directories. Images
+ * don't carry pixel data.
+ */
+static GByteArray *
+build_cache (A2DIconCache *icon_cache)
+{
+    GByteArray *data = g_byte_array_new ();
+    GPtrArray *directories = g_ptr_array_new ();
+    GHashTable *icons = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                               (GDestroyNotify) g_array_unref);
+    GPtrArray **buckets;
+    GHashTableIter iter;
+    gpointer key, value;
+    guint32 directory_list_offset;
+    guint n_buckets;
+    guint ii, jj;
+
+    /* Directories containing icons, sorted for stable output */
+    g_hash_table_iter_init (&iter, icon_cache->directories);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        if (g_hash_table_size (((A2DIconDirectory *) value)->icons) > 0)
+            g_ptr_array_add (directories, key);
+    }
+
+    g_ptr_array_sort (directories, compare_strings);
+
+    for (ii = 0; ii < directories->len; ii++) {
+        A2DIconDirectory *directory =
+            g_hash_table_lookup (icon_cache->directories, g_ptr_array_index (directories, ii));
+
+        g_hash_table_iter_init (&iter, directory->icons);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            GArray *images = g_hash_table_lookup (icons, key);
+            A2DIconImage image;
+
+            if (!images) {
+                images = g_array_new (FALSE, FALSE, sizeof (A2DIconImage));
+                g_hash_table_insert (icons, key, images);
+            }
+
+            image.directory = ii;
+            image.flags = GPOINTER_TO_UINT (value);
+            g_array_append_val (images, image);
+        }
+    }
+
+    n_buckets = g_spaced_primes_closest (MAX (g_hash_table_size (icons) / 3, 1));
+    buckets = g_new0 (GPtrArray *, n_buckets);
+
+    g_hash_table_iter_init (&iter, icons);
+    while (g_hash_table_iter_next (&iter, &key, NULL)) {
+        guint bucket = icon_name_hash (key) % n_buckets;
+
+        if (!buckets[bucket])
+            buckets[bucket] = g_ptr_array_new ();
+
+        g_ptr_array_add (buckets[bucket], key);
+    }
+
+    /* Header, offset of the directory list is set at the end */
+    append_card16 (data, CACHE_MAJOR_VERSION);
+    append_card16 (data, CACHE_MINOR_VERSION);
+    append_card32 (data, 12);
+    append_card32 (data, 0);
+
+    append_card32 (data, n_buckets);
+    for (ii = 0; ii < n_buckets; ii++)
+        append_card32 (data, NO_OFFSET);
+
+    for (ii = 0; ii < n_buckets; ii++) {
+        /* Offset pointing to the next icon of the chain */
+        guint32 link_offset = 16 + 4 * ii;
+
+        if (!buckets[ii])
+            continue;
+
+        g_ptr_array_sort (buckets[ii], compare_strings);
+
+        for (jj = 0; jj < buckets[ii]->len; jj++) {
+            const gchar *name = g_ptr_array_index (buckets[ii], jj);
+            GArray *images = g_hash_table_lookup (icons, name);
+            guint32 icon_offset = data->len;
+            guint kk;
+
+            set_card32 (data, link_offset, icon_offset);
+            link_offset = icon_offset;
+
+            append_card32 (data, NO_OFFSET);
+            append_card32 (data, 0);
+            append_card32 (data, 0);
+
+            set_card32 (data, icon_offset + 4, append_string (data, name));
+            set_card32 (data, icon_offset + 8, data->len);
+
+            append_card32 (data, images->len);
+            for (kk = 0; kk < images->len; kk++) {
+                A2DIconImage *image = &g_array_index (images, A2DIconImage, kk);
+
+                append_card16 (data, image->directory);
+                append_card16 (data, image->flags);
+                append_card32 (data, 0);
+            }
+        }
+
+        g_ptr_array_free (buckets[ii], TRUE);
+    }
+
+    directory_list_offset = data->len;
+    set_card32 (data, 8, directory_list_offset);
+
+    append_card32 (data, directories->len);
+    for (ii = 0; ii < directories->len; ii++)
+        append_card32 (data, 0);
+
+    for (ii = 0; ii < directories->len; ii++)
+        set_card32 (data, directory_list_offset + 4 + 4 * ii,
+                    append_string (data, g_ptr_array_index (directories, ii)));
+
+    g_free (buckets);
+    g_hash_table_destroy (icons);
+    g_ptr_array_free (directories, TRUE);
+
+    return data;
+}
+
+/*
+ * write_cache:
+ *
+ * Writes the cache and makes it at least as new as the theme directory,
+ * otherwise GTK considers it outdated.
+ */
+static gboolean
+write_cache (A2DIconCache *icon_cache)
+{
+    GByteArray *data = build_cache (icon_cache);
+    gchar *cache_path = g_build_filename (icon_cache->theme_directory, CACHE_FILE, NULL);
+    GStatBuf stat_buf;
+    gboolean ret_val;
+
+    ret_val = g_file_set_contents (cache_path, (const gchar *) data->data, data->len, NULL);
+
+    if (ret_val && !g_stat (icon_cache->theme_directory, &stat_buf)) {
+        struct utimbuf utim_buf;
+
+        utim_buf.actime = stat_buf.st_atime;
+        utim_buf.modtime = stat_buf.st_mtime;
+        g_utime (cache_path, &utim_buf);
+    }
+
+    g_free (cache_path);
+    g_byte_array_free (data, TRUE);
+
+    return ret_val;
+}
+
+/*
+ * a2d_icon_cache_new:
+ *
+ * Creates cache of the icon theme in the given directory. Nothing is read
+ * until the first update.
+ */
+A2DIconCache *
+a2d_icon_cache_new (const gchar *theme_directory)
+{
+    A2DIconCache *icon_cache = g_new0 (A2DIconCache, 1);
+
+    icon_cache->theme_directory = g_strdup (theme_directory);
+    icon_cache->directories = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     g_free, icon_directory_free);
+
+    return icon_cache;
+}
+
+/*
+ * a2d_icon_cache_free:
+ */
+void
+a2d_icon_cache_free (A2DIconCache *icon_cache)
+{
+    if (!icon_cache)
+        return;
+
+    g_hash_table_destroy (icon_cache->directories);
+    g_free (icon_cache->theme_directory);
+    g_free (icon_cache);
+}
+
+/*
+ * a2d_icon_cache_update:
+ *
+ * Rescans size directories changed by us (e.g. "48x48") and directories
+ * with new modification time, then rewrites icon-theme.cache when anything
+ * changed. Returns TRUE when the cache was written.
+ */
+gboolean
+a2d_icon_cache_update (A2DIconCache *icon_cache, GHashTable *changed_directories)
+{
+    gchar *cache_path;
+    gboolean missing;
+
+    cache_path = g_build_filename (icon_cache->theme_directory, CACHE_FILE, NULL);
+    missing = !g_file_test (cache_path, G_FILE_TEST_EXISTS);
+    g_free (cache_path);
+
+    if (!refresh (icon_cache, changed_directories) && !missing)
+        return FALSE;
+
+    if (!write_cache (icon_cache))
+        return FALSE;
+
+    a2d_stats_add (A2D_STAT_ICON_CACHE_WRITES, 1);
+
+    return TRUE;
+}
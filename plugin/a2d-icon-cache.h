@@ -0,0 +1,39 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_ICON_CACHE_H
+#define __A2D_ICON_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct A2DIconCache A2DIconCache;
+
+A2DIconCache *	a2d_icon_cache_new			(const gchar *theme_directory);
+void		a2d_icon_cache_free			(A2DIconCache *icon_cache);
+gboolean	a2d_icon_cache_update			(A2DIconCache *icon_cache,
+							 GHashTable *changed_directories);
+
+G_END_DECLS
+
+#endif /* __A2D_ICON_CACHE_H */
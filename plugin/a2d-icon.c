@@ -0,0 +1,135 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a2d-icon.h"
+
+#define PNG_SIGNATURE "\x89PNG\r\n\x1a\n"
+#define PNG_HEADER_LENGTH 24
+#define PNG_MAX_SIZE 4096
+
+/* Sizes of the hicolor theme shells ask for */
+static const guint standard_sizes[] = {
+    16, 22, 24, 32, 48, 64, 128, 256
+};
+
+static guint32
+read_card32 (const guchar *data)
+{
+    return ((guint32) data[0] << 24) | ((guint32) data[1] << 16) |
+        ((guint32) data[2] << 8) | data[3];
+}
+
+/*
+ * a2d_icon_read_png_size:
+ *
+ * Reads dimensions of the PNG image from its IHDR chunk, the rest of the file
+ * is not read. Returns FALSE when the file is not a PNG image.
+ */
+gboolean
+a2d_icon_read_png_size (const gchar *filename, guint *width, guint *height)
+{
+    guchar header[PNG_HEADER_LENGTH];
+    gssize length;
+    gint fd;
+
+    fd = open (filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return FALSE;
+
+    length = read (fd, header, sizeof (header));
+    close (fd);
+
+    /* Signature is followed by the IHDR chunk: length, type, width, height */
+    if (length != sizeof (header) ||
+        memcmp (header, PNG_SIGNATURE, 8) != 0 ||
+        read_card32 (header + 8) != 13 ||
+        memcmp (header + 12, "IHDR", 4) != 0)
+        return FALSE;
+
+    *width = read_card32 (header + 16);
+    *height = read_card32 (header + 20);
+
+    return *width > 0 && *height > 0 && *width <= PNG_MAX_SIZE && *height <= PNG_MAX_SIZE;
+}
+
+/*
+ * a2d_icon_is_standard_size:
+ */
+gboolean
+a2d_icon_is_standard_size (guint size)
+{
+    guint ii;
+
+    for (ii = 0; ii < G_N_ELEMENTS (standard_sizes); ii++) {
+        if (standard_sizes[ii] == size)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * a2d_icon_get_standard_sizes:
+ *
+ * Returns sizes of the icons every app should have, in ascending order.
+ */
+const guint *
+a2d_icon_get_standard_sizes (guint *n_sizes)
+{
+    *n_sizes = G_N_ELEMENTS (standard_sizes);
+
+    return standard_sizes;
+}
+
+/*
+ * a2d_icon_scale:
+ *
+ * Scales the icon to the given size and returns it encoded as PNG, or NULL
+ * on failure. Scaling is done by gdk-pixbuf while the image is loaded.
+ */
+gchar *
+a2d_icon_scale (const gchar *source, guint size, gsize *length)
+{
+    GdkPixbuf *pixbuf;
+    gchar *data = NULL;
+
+    pixbuf = gdk_pixbuf_new_from_file_at_size (source, size, size, NULL);
+    if (!pixbuf)
+        return NULL;
+
+    if (gdk_pixbuf_get_width (pixbuf) != (gint) size ||
+        gdk_pixbuf_get_height (pixbuf) != (gint) size ||
+        !gdk_pixbuf_save_to_buffer (pixbuf, &data, length, "png", NULL, NULL)) {
+        g_free (data);
+        data = NULL;
+    }
+
+    g_object_unref (pixbuf);
+
+    return data;
+}
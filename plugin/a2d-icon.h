@@ -0,0 +1,41 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_ICON_H
+#define __A2D_ICON_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean	a2d_icon_read_png_size			(const gchar *filename,
+							 guint *width,
+							 guint *height);
+gboolean	a2d_icon_is_standard_size		(guint size);
+const guint *	a2d_icon_get_standard_sizes		(guint *n_sizes);
+gchar *		a2d_icon_scale				(const gchar *source,
+							 guint size,
+							 gsize *length);
+
+G_END_DECLS
+
+#endif /* __A2D_ICON_H */
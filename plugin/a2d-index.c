@@ -0,0 +1,354 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a2d-index.h"
+
+#define INDEX_MAGIC 0x49443241 /* "A2DI" */
+#define INDEX_VERSION 3
+#define INDEX_INITIAL_CAPACITY 64
+
+/* Index file starts with the header followed by the array of records */
+typedef struct
+{
+    guint32		magic;
+    guint32		version;
+    guint32		record_size;
+    guint32		n_records;
+} A2DIndexHeader;
+
+struct A2DIndex
+{
+    GMutex		 mutex;
+    gint		 fd;
+    gchar		*map;
+    gsize		 map_size;
+    guint		 capacity;
+    gboolean		 created;
+    /* app id -> position of its record + 1 */
+    GHashTable		*records;
+};
+
+#define INDEX_HEADER(index) ((A2DIndexHeader *) (index)->map)
+#define INDEX_RECORDS(index) ((A2DIndexRecord *) ((index)->map + sizeof (A2DIndexHeader)))
+
+/*
+ * index_map:
+ *
+ * Resizes the index file to hold given number of records and maps it.
+ */
+static gboolean
+index_map (A2DIndex *index, guint capacity)
+{
+    gsize map_size = sizeof (A2DIndexHeader) + capacity * sizeof (A2DIndexRecord);
+
+    if (index->map)
+        munmap (index->map, index->map_size);
+    index->map = NULL;
+
+    if (ftruncate (index->fd, map_size) < 0)
+        return FALSE;
+
+    index->map = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, index->fd, 0);
+    if (index->map == MAP_FAILED) {
+        index->map = NULL;
+        return FALSE;
+    }
+
+    index->map_size = map_size;
+    index->capacity = capacity;
+
+    return TRUE;
+}
+
+/*
+ * index_load:
+ *
+ * Validates mapped index and loads the app ids. Invalid index is reset.
+ */
+static void
+index_load (A2DIndex *index)
+{
+    A2DIndexHeader *header = INDEX_HEADER (index);
+    guint ii;
+
+    if (header->magic != INDEX_MAGIC ||
+        header->version != INDEX_VERSION ||
+        header->record_size != sizeof (A2DIndexRecord) ||
+        header->n_records > index->capacity) {
+        header->magic = INDEX_MAGIC;
+        header->version = INDEX_VERSION;
+        header->record_size = sizeof (A2DIndexRecord);
+        header->n_records = 0;
+        index->created = TRUE;
+
+        return;
+    }
+
+    for (ii = 0; ii < header->n_records; ii++) {
+        A2DIndexRecord *record = &INDEX_RECORDS (index)[ii];
+
+        record->app_id[sizeof (record->app_id) - 1] = '\0';
+        record->app_version[sizeof (record->app_version) - 1] = '\0';
+        record->extension_version[sizeof (record->extension_version) - 1] = '\0';
+        record->generated_name[sizeof (record->generated_name) - 1] = '\0';
+        record->n_icon_sizes = MIN (record->n_icon_sizes, A2D_INDEX_MAX_ICONS);
+
+        g_hash_table_insert (index->records,
+                             g_strdup (record->app_id),
+                             GUINT_TO_POINTER (ii + 1));
+    }
+}
+
+/*
+ * a2d_index_open:
+ *
+ * Opens (or creates) index file with the given name. Returns NULL when the
+ * file can't be used.
+ */
+A2DIndex *
+a2d_index_open (const gchar *filename)
+{
+    A2DIndex *index;
+    GStatBuf stat_buf;
+    guint capacity = INDEX_INITIAL_CAPACITY;
+    gchar *directory = g_path_get_dirname (filename);
+
+    g_mkdir_with_parents (directory, 0700);
+    g_free (directory);
+
+    index = g_new0 (A2DIndex, 1);
+    g_mutex_init (&index->mutex);
+    index->records = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    index->fd = g_open (filename, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (index->fd < 0)
+        goto error;
+
+    if (fstat (index->fd, &stat_buf) == 0 && (gsize) stat_buf.st_size > sizeof (A2DIndexHeader))
+        capacity = MAX (capacity,
+                        (stat_buf.st_size - sizeof (A2DIndexHeader)) / sizeof (A2DIndexRecord));
+
+    if (!index_map (index, capacity))
+        goto error;
+
+    index_load (index);
+
+    return index;
+
+ error:
+    a2d_index_close (index);
+
+    return NULL;
+}
+
+/*
+ * a2d_index_close:
+ */
+void
+a2d_index_close (A2DIndex *index)
+{
+    if (!index)
+        return;
+
+    if (index->map) {
+        msync (index->map, index->map_size, MS_ASYNC);
+        munmap (index->map, index->map_size);
+    }
+
+    if (index->fd >= 0)
+        close (index->fd);
+
+    g_hash_table_destroy (index->records);
+    g_mutex_clear (&index->mutex);
+    g_free (index);
+}
+
+/*
+ * a2d_index_lookup:
+ *
+ * Copies record of app with given id. Returns FALSE if there is no such app
+ * in the index.
+ */
+gboolean
+a2d_index_lookup (A2DIndex *index, const gchar *app_id, A2DIndexRecord *record)
+{
+    guint position;
+
+    g_mutex_lock (&index->mutex);
+
+    position = GPOINTER_TO_UINT (g_hash_table_lookup (index->records, app_id));
+    if (position)
+        memcpy (record, &INDEX_RECORDS (index)[position - 1], sizeof (A2DIndexRecord));
+
+    g_mutex_unlock (&index->mutex);
+
+    return position != 0;
+}
+
+/*
+ * a2d_index_store:
+ *
+ * Inserts or replaces record of the app.
+ */
+void
+a2d_index_store (A2DIndex *index, const A2DIndexRecord *record)
+{
+    guint position;
+
+    g_mutex_lock (&index->mutex);
+
+    position = GPOINTER_TO_UINT (g_hash_table_lookup (index->records, record->app_id));
+    if (!position) {
+        A2DIndexHeader *header = INDEX_HEADER (index);
+
+        if (header->n_records == index->capacity &&
+            !index_map (index, index->capacity * 2)) {
+            /* Keep the index usable with the old size */
+            index_map (index, index->capacity);
+            goto out;
+        }
+
+        header = INDEX_HEADER (index);
+        position = ++header->n_records;
+        g_hash_table_insert (index->records,
+                             g_strdup (record->app_id),
+                             GUINT_TO_POINTER (position));
+    }
+
+    memcpy (&INDEX_RECORDS (index)[position - 1], record, sizeof (A2DIndexRecord));
+
+ out:
+    g_mutex_unlock (&index->mutex);
+}
+
+/*
+ * a2d_index_remove:
+ *
+ * Removes record of the app. The last record takes its place, so the
+ * records are always stored continuously.
+ */
+gboolean
+a2d_index_remove (A2DIndex *index, const gchar *app_id)
+{
+    A2DIndexHeader *header;
+    guint position;
+
+    g_mutex_lock (&index->mutex);
+
+    position = GPOINTER_TO_UINT (g_hash_table_lookup (index->records, app_id));
+    if (!position)
+        goto out;
+
+    g_hash_table_remove (index->records, app_id);
+
+    header = INDEX_HEADER (index);
+    if (position != header->n_records) {
+        A2DIndexRecord *last = &INDEX_RECORDS (index)[header->n_records - 1];
+
+        memcpy (&INDEX_RECORDS (index)[position - 1], last, sizeof (A2DIndexRecord));
+        g_hash_table_insert (index->records,
+                             g_strdup (last->app_id),
+                             GUINT_TO_POINTER (position));
+    }
+
+    header->n_records--;
+
+ out:
+    g_mutex_unlock (&index->mutex);
+
+    return position != 0;
+}
+
+/*
+ * a2d_index_flush:
+ *
+ * Schedules write of the modified index to the disk.
+ */
+void
+a2d_index_flush (A2DIndex *index)
+{
+    g_mutex_lock (&index->mutex);
+    msync (index->map, index->map_size, MS_ASYNC);
+    g_mutex_unlock (&index->mutex);
+}
+
+/*
+ * a2d_index_get_size:
+ *
+ * Returns number of apps in the index.
+ */
+guint
+a2d_index_get_size (A2DIndex *index)
+{
+    guint size;
+
+    g_mutex_lock (&index->mutex);
+    size = g_hash_table_size (index->records);
+    g_mutex_unlock (&index->mutex);
+
+    return size;
+}
+
+/*
+ * a2d_index_get_app_ids:
+ *
+ * Returns array with copies of ids of all apps in the index.
+ */
+GPtrArray *
+a2d_index_get_app_ids (A2DIndex *index)
+{
+    GPtrArray *app_ids;
+    GHashTableIter iter;
+    gpointer app_id;
+
+    g_mutex_lock (&index->mutex);
+
+    app_ids = g_ptr_array_new_with_free_func (g_free);
+    g_hash_table_iter_init (&iter, index->records);
+    while (g_hash_table_iter_next (&iter, &app_id, NULL))
+        g_ptr_array_add (app_ids, g_strdup (app_id));
+
+    g_mutex_unlock (&index->mutex);
+
+    return app_ids;
+}
+
+/*
+ * a2d_index_was_created:
+ *
+ * Returns TRUE when the index didn't exist (or was unusable) and it was
+ * created empty.
+ */
+gboolean
+a2d_index_was_created (A2DIndex *index)
+{
+    return index->created;
+}
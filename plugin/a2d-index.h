@@ -0,0 +1,72 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_INDEX_H
+#define __A2D_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define A2D_INDEX_MAX_ICONS 16
+
+/* Record about one generated app, it is stored in the index file as is */
+typedef struct
+{
+	gchar		app_id[64];
+	gchar		app_version[32];
+	/* name of the extension's version directory the app was generated from */
+	gchar		extension_version[64];
+	/* name of the .desktop file and of icons without suffix */
+	gchar		generated_name[96];
+	gint64		manifest_mtime;
+	guint16		icon_sizes[A2D_INDEX_MAX_ICONS];
+	guint8		n_icon_sizes;
+	guint8		enabled;
+	/* bit per icon_sizes entry, set when the icon was scaled by us */
+	guint16		generated_icons;
+	guint8		padding[4];
+	/* hash of the source icons the generated ones were scaled from */
+	guint64		icon_fingerprint;
+	/* hash of the app's data and of the manifest's stat */
+	guint64		input_fingerprint;
+} A2DIndexRecord;
+
+typedef struct A2DIndex A2DIndex;
+
+A2DIndex *	a2d_index_open				(const gchar *filename);
+void		a2d_index_close				(A2DIndex *index);
+gboolean	a2d_index_lookup			(A2DIndex *index,
+							 const gchar *app_id,
+							 A2DIndexRecord *record);
+void		a2d_index_store				(A2DIndex *index,
+							 const A2DIndexRecord *record);
+gboolean	a2d_index_remove			(A2DIndex *index,
+							 const gchar *app_id);
+void		a2d_index_flush				(A2DIndex *index);
+guint		a2d_index_get_size			(A2DIndex *index);
+GPtrArray *	a2d_index_get_app_ids			(A2DIndex *index);
+gboolean	a2d_index_was_created			(A2DIndex *index);
+
+G_END_DECLS
+
+#endif /* __A2D_INDEX_H */
@@ -0,0 +1,352 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <glib.h>
+#include <string.h>
+
+#include "a2d-json.h"
+
+/*
+ * a2d_json_scanner_init:
+ *
+ * Prepares scanner for reading the contents, UTF-8 byte order mark is
+ * skipped.
+ */
+void
+a2d_json_scanner_init (A2DJsonScanner *scanner, const gchar *contents, gsize length)
+{
+    scanner->pos = contents;
+    scanner->end = contents + length;
+
+    if (length >= 3 && memcmp (contents, "\xef\xbb\xbf", 3) == 0)
+        scanner->pos += 3;
+}
+
+/*
+ * a2d_json_peek:
+ *
+ * Returns the next character after whitespace or '\0' at the end.
+ */
+gchar
+a2d_json_peek (A2DJsonScanner *scanner)
+{
+    a2d_json_skip_whitespace (scanner);
+
+    return scanner->pos < scanner->end ? *scanner->pos : '\0';
+}
+
+/*
+ * a2d_json_is_at_end:
+ *
+ * Returns TRUE when only whitespace is left.
+ */
+gboolean
+a2d_json_is_at_end (A2DJsonScanner *scanner)
+{
+    a2d_json_skip_whitespace (scanner);
+
+    return scanner->pos == scanner->end;
+}
+
+/*
+ * a2d_json_skip_whitespace:
+ *
+ * Skips whitespace and comments, Chrome accepts both kinds of C comments in
+ * the manifest.
+ */
+void
+a2d_json_skip_whitespace (A2DJsonScanner *scanner)
+{
+    while (scanner->pos < scanner->end) {
+        const gchar *pos = scanner->pos;
+
+        if (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r') {
+            scanner->pos++;
+        } else if (*pos == '/' && pos + 1 < scanner->end && pos[1] == '/') {
+            const gchar *newline = memchr (pos, '\n', scanner->end - pos);
+
+            scanner->pos = newline ? newline + 1 : scanner->end;
+        } else if (*pos == '/' && pos + 1 < scanner->end && pos[1] == '*') {
+            const gchar *comment_end = g_strstr_len (pos + 2, scanner->end - pos - 2, "*/");
+
+            scanner->pos = comment_end ? comment_end + 2 : scanner->end;
+        } else {
+            break;
+        }
+    }
+}
+
+gboolean
+a2d_json_expect (A2DJsonScanner *scanner, gchar c)
+{
+    a2d_json_skip_whitespace (scanner);
+
+    if (scanner->pos == scanner->end || *scanner->pos != c)
+        return FALSE;
+
+    scanner->pos++;
+
+    return TRUE;
+}
+
+/*
+ * skip_string:
+ *
+ * Skips string starting at the current position. The closing quote is found
+ * by memchr, escaped quotes are recognized by the preceding backslashes.
+ */
+static gboolean
+skip_string (A2DJsonScanner *scanner)
+{
+    const gchar *pos = scanner->pos + 1;
+
+    for (;;) {
+        const gchar *quote = memchr (pos, '"', scanner->end - pos);
+        const gchar *backslash;
+
+        if (!quote)
+            return FALSE;
+
+        backslash = quote;
+        while (backslash > pos && backslash[-1] == '\\')
+            backslash--;
+
+        pos = quote + 1;
+
+        if ((quote - backslash) % 2 == 0)
+            break;
+    }
+
+    scanner->pos = pos;
+
+    return TRUE;
+}
+
+static gboolean
+read_unicode_escape (A2DJsonScanner *scanner, gunichar *value)
+{
+    gint ii;
+
+    if (scanner->end - scanner->pos < 4)
+        return FALSE;
+
+    *value = 0;
+    for (ii = 0; ii < 4; ii++) {
+        gint digit = g_ascii_xdigit_value (scanner->pos[ii]);
+
+        if (digit < 0)
+            return FALSE;
+
+        *value = (*value << 4) | digit;
+    }
+
+    scanner->pos += 4;
+
+    return TRUE;
+}
+
+/*
+ * a2d_json_read_string:
+ *
+ * Reads string starting at the current position into value, escape sequences
+ * are decoded.
+ */
+gboolean
+a2d_json_read_string (A2DJsonScanner *scanner, GString *value)
+{
+    g_string_truncate (value, 0);
+
+    if (!a2d_json_expect (scanner, '"'))
+        return FALSE;
+
+    while (scanner->pos < scanner->end) {
+        const gchar *pos = scanner->pos;
+        gunichar unichar;
+
+        /* Copies the plain run at once */
+        while (pos < scanner->end && *pos != '"' && *pos != '\\')
+            pos++;
+
+        g_string_append_len (value, scanner->pos, pos - scanner->pos);
+        scanner->pos = pos;
+
+        if (pos == scanner->end)
+            return FALSE;
+
+        scanner->pos++;
+
+        if (*pos == '"')
+            return TRUE;
+
+        if (scanner->pos == scanner->end)
+            return FALSE;
+
+        switch (*scanner->pos++) {
+        case '"': g_string_append_c (value, '"'); break;
+        case '\\': g_string_append_c (value, '\\'); break;
+        case '/': g_string_append_c (value, '/'); break;
+        case 'b': g_string_append_c (value, '\b'); break;
+        case 'f': g_string_append_c (value, '\f'); break;
+        case 'n': g_string_append_c (value, '\n'); break;
+        case 'r': g_string_append_c (value, '\r'); break;
+        case 't': g_string_append_c (value, '\t'); break;
+        case 'u':
+            if (!read_unicode_escape (scanner, &unichar))
+                return FALSE;
+
+            /* Surrogate pair */
+            if (unichar >= 0xd800 && unichar < 0xdc00) {
+                gunichar low;
+
+                if (scanner->end - scanner->pos < 6 ||
+                    scanner->pos[0] != '\\' || scanner->pos[1] != 'u')
+                    return FALSE;
+
+                scanner->pos += 2;
+                if (!read_unicode_escape (scanner, &low) || low < 0xdc00 || low >= 0xe000)
+                    return FALSE;
+
+                unichar = 0x10000 + ((unichar - 0xd800) << 10) + (low - 0xdc00);
+            }
+
+            g_string_append_unichar (value, unichar);
+            break;
+        default:
+            return FALSE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * a2d_json_skip_value:
+ *
+ * Skips value starting at the current position including nested objects and
+ * arrays, nothing is allocated. Structure is not validated, manifests that
+ * Chrome refused to load never get here.
+ */
+gboolean
+a2d_json_skip_value (A2DJsonScanner *scanner)
+{
+    gint depth = 0;
+
+    do {
+        a2d_json_skip_whitespace (scanner);
+
+        if (scanner->pos == scanner->end)
+            return FALSE;
+
+        switch (*scanner->pos) {
+        case '"':
+            if (!skip_string (scanner))
+                return FALSE;
+            break;
+        case '{':
+        case '[':
+            depth++;
+            scanner->pos++;
+            break;
+        case '}':
+        case ']':
+            if (--depth < 0)
+                return FALSE;
+            scanner->pos++;
+            break;
+        case ',':
+        case ':':
+            if (depth == 0)
+                return FALSE;
+            scanner->pos++;
+            break;
+        default:
+            if (!g_ascii_isalnum (*scanner->pos) && *scanner->pos != '-')
+                return FALSE;
+
+            while (scanner->pos < scanner->end &&
+                   (g_ascii_isalnum (*scanner->pos) || strchr ("+-.", *scanner->pos)))
+                scanner->pos++;
+            break;
+        }
+    } while (depth > 0);
+
+    return TRUE;
+}
+
+/*
+ * a2d_json_read_boolean:
+ *
+ * Reads boolean value, other values are skipped and read as FALSE like
+ * json-glib does.
+ */
+gboolean
+a2d_json_read_boolean (A2DJsonScanner *scanner, gboolean *value)
+{
+    a2d_json_skip_whitespace (scanner);
+
+    *value = FALSE;
+
+    if (scanner->end - scanner->pos >= 4 && memcmp (scanner->pos, "true", 4) == 0) {
+        *value = TRUE;
+        scanner->pos += 4;
+
+        return TRUE;
+    }
+
+    return a2d_json_skip_value (scanner);
+}
+
+/*
+ * a2d_json_read_object:
+ *
+ * Iterates over the members of object starting at the current position. Member
+ * name is passed to the callback which has to consume the value.
+ */
+gboolean
+a2d_json_read_object (A2DJsonScanner *scanner, GString *name,
+                      A2DJsonMemberFunc read_member, gpointer user_data)
+{
+    if (!a2d_json_expect (scanner, '{'))
+        return FALSE;
+
+    if (a2d_json_expect (scanner, '}'))
+        return TRUE;
+
+    for (;;) {
+        if (!a2d_json_read_string (scanner, name) || !a2d_json_expect (scanner, ':'))
+            return FALSE;
+
+        if (!read_member (scanner, name, user_data))
+            return FALSE;
+
+        if (a2d_json_expect (scanner, '}'))
+            return TRUE;
+
+        if (!a2d_json_expect (scanner, ','))
+            return FALSE;
+
+        /* Trailing comma */
+        if (a2d_json_expect (scanner, '}'))
+            return TRUE;
+    }
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#ifndef __A2D_JSON_H
+#define __A2D_JSON_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Position in JSON data read by the streaming scanner */
+typedef struct {
+	const gchar	*pos;
+	const gchar	*end;
+} A2DJsonScanner;
+
+typedef gboolean (*A2DJsonMemberFunc) (A2DJsonScanner *scanner,
+				       GString *name,
+				       gpointer user_data);
+
+void		a2d_json_scanner_init			(A2DJsonScanner *scanner,
+							 const gchar *contents,
+							 gsize length);
+void		a2d_json_skip_whitespace		(A2DJsonScanner *scanner);
+gchar		a2d_json_peek				(A2DJsonScanner *scanner);
+gboolean	a2d_json_is_at_end			(A2DJsonScanner *scanner);
+gboolean	a2d_json_expect				(A2DJsonScanner *scanner,
+							 gchar c);
+gboolean	a2d_json_read_string			(A2DJsonScanner *scanner,
+							 GString *value);
+gboolean	a2d_json_read_boolean			(A2DJsonScanner *scanner,
+							 gboolean *value);
+gboolean	a2d_json_skip_value			(A2DJsonScanner *scanner);
+gboolean	a2d_json_read_object			(A2DJsonScanner *scanner,
+							 GString *name,
+							 A2DJsonMemberFunc read_member,
+							 gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __A2D_JSON_H */
@@ -0,0 +1,595 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "a2d-json.h"
+#include "a2d-locale.h"
+#include "a2d-stats.h"
+
+#define MESSAGES_FILE "messages.json"
+#define MESSAGE_PREFIX "__MSG_"
+#define MESSAGE_SUFFIX "__"
+#define FILES_PER_THREAD 8
+#define CACHE_MAX_ENTRIES 4096
+
+/* Strings extracted from one messages.json file */
+typedef struct {
+    gint64		 mtime;
+    gint64		 size;
+    gchar		*name_key;
+    gchar		*comment_key;
+    gchar		*name;
+    gchar		*comment;
+} A2DLocaleCacheEntry;
+
+/*
+ * Cache of extracted strings, entries are valid while modification time and
+ * size of the file don't change.
+ */
+struct A2DLocaleCatalog
+{
+    GMutex		 mutex;
+    /* path of messages.json -> A2DLocaleCacheEntry */
+    GHashTable		*cache;
+    /* shared by all lookups, which can run in parallel */
+    GThreadPool		*pool;
+};
+
+/* messages.json of one locale directory being looked up */
+typedef struct {
+    gchar		*locale;
+    gchar		*path;
+    gint64		 mtime;
+    gint64		 size;
+    gchar		*name;
+    gchar		*comment;
+} A2DLocaleFile;
+
+typedef struct {
+    GPtrArray		*files;
+    const gchar		*name_key;
+    const gchar		*comment_key;
+    GMutex		 mutex;
+    GCond		 cond;
+    guint		 pending;	/* slices not parsed yet */
+} A2DLocaleJob;
+
+typedef struct {
+    A2DLocaleJob	*job;
+    guint		 first;
+    guint		 last;
+} A2DLocaleSlice;
+
+/* State of the streaming scan of messages.json */
+typedef struct {
+    const gchar		*name_key;
+    const gchar		*comment_key;
+    GString		*member_name;
+    gchar		*name;
+    gchar		*comment;
+} A2DMessagesReader;
+
+static void
+cache_entry_free (gpointer data)
+{
+    A2DLocaleCacheEntry *entry = data;
+
+    g_free (entry->name_key);
+    g_free (entry->comment_key);
+    g_free (entry->name);
+    g_free (entry->comment);
+    g_free (entry);
+}
+
+static void
+locale_file_free (gpointer data)
+{
+    A2DLocaleFile *file = data;
+
+    g_free (file->locale);
+    g_free (file->path);
+    g_free (file->name);
+    g_free (file->comment);
+    g_free (file);
+}
+
+static void
+localization_free (gpointer data)
+{
+    A2DLocalization *localization = data;
+
+    g_free (localization->locale);
+    g_free (localization->name);
+    g_free (localization->comment);
+    g_free (localization);
+}
+
+/*
+ * read_message_member:
+ *
+ * Reads the message of the entry, its description and placeholders are
+ * skipped.
+ */
+static gboolean
+read_message_member (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    gchar **target = user_data;
+    GString *value;
+
+    if (strcmp (name->str, "message") != 0 || a2d_json_peek (scanner) != '"')
+        return a2d_json_skip_value (scanner);
+
+    value = g_string_new (NULL);
+    if (!a2d_json_read_string (scanner, value)) {
+        g_string_free (value, TRUE);
+
+        return FALSE;
+    }
+
+    g_free (*target);
+    *target = g_string_free (value, FALSE);
+
+    return TRUE;
+}
+
+/*
+ * read_messages_member:
+ *
+ * Descends only into the entries we look for, the rest of the UI strings is
+ * skipped without being decoded. Message names are case insensitive.
+ */
+static gboolean
+read_messages_member (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    A2DMessagesReader *reader = user_data;
+    gchar **target = NULL;
+
+    if (g_ascii_strcasecmp (name->str, reader->name_key) == 0)
+        target = &reader->name;
+    else if (reader->comment_key && g_ascii_strcasecmp (name->str, reader->comment_key) == 0)
+        target = &reader->comment;
+
+    if (!target || a2d_json_peek (scanner) != '{')
+        return a2d_json_skip_value (scanner);
+
+    return a2d_json_read_object (scanner, reader->member_name, read_message_member, target);
+}
+
+/*
+ * get_message_json_glib:
+ *
+ * Looks up message with given case insensitive name in the parsed file.
+ */
+static gchar *
+get_message_json_glib (JsonReader *reader, gchar **members, const gchar *key)
+{
+    gchar *message = NULL;
+    gint ii;
+
+    if (!key)
+        return NULL;
+
+    for (ii = 0; members && members[ii]; ii++) {
+        if (g_ascii_strcasecmp (members[ii], key) != 0)
+            continue;
+
+        if (json_reader_read_member (reader, members[ii]) &&
+            json_reader_read_member (reader, "message") &&
+            json_reader_is_value (reader)) {
+            g_free (message);
+            message = g_strdup (json_reader_get_string_value (reader));
+        }
+
+        json_reader_end_member (reader);
+        json_reader_end_member (reader);
+    }
+
+    return message;
+}
+
+/*
+ * parse_json_glib:
+ *
+ * Reads messages through json-glib, used when the streaming reader doesn't
+ * understand the file.
+ */
+static gboolean
+parse_json_glib (const gchar *contents, gsize length, A2DMessagesReader *reader)
+{
+    JsonParser *parser = json_parser_new ();
+    JsonReader *json_reader;
+    gchar **members;
+
+    if (!json_parser_load_from_data (parser, contents, length, NULL)) {
+        g_object_unref (parser);
+
+        return FALSE;
+    }
+
+    json_reader = json_reader_new (json_parser_get_root (parser));
+    members = json_reader_list_members (json_reader);
+
+    reader->name = get_message_json_glib (json_reader, members, reader->name_key);
+    reader->comment = get_message_json_glib (json_reader, members, reader->comment_key);
+
+    g_strfreev (members);
+    g_object_unref (json_reader);
+    g_object_unref (parser);
+
+    return TRUE;
+}
+
+/*
+ * parse_messages_file:
+ *
+ * Extracts the name and the comment of app from messages.json of one locale.
+ */
+static void
+parse_messages_file (A2DLocaleFile *file, const gchar *name_key, const gchar *comment_key)
+{
+    GMappedFile *mapped_file;
+    A2DMessagesReader reader;
+    A2DJsonScanner scanner;
+    const gchar *contents;
+    gsize length;
+
+    mapped_file = g_mapped_file_new (file->path, FALSE, NULL);
+    if (!mapped_file)
+        return;
+
+    contents = g_mapped_file_get_contents (mapped_file);
+    length = g_mapped_file_get_length (mapped_file);
+
+    memset (&reader, 0, sizeof (A2DMessagesReader));
+    reader.name_key = name_key;
+    reader.comment_key = comment_key;
+    reader.member_name = g_string_new (NULL);
+
+    a2d_json_scanner_init (&scanner, contents, length);
+
+    if (!a2d_json_read_object (&scanner, reader.member_name, read_messages_member, &reader) ||
+        !a2d_json_is_at_end (&scanner)) {
+        g_clear_pointer (&reader.name, g_free);
+        g_clear_pointer (&reader.comment, g_free);
+
+        parse_json_glib (contents, length, &reader);
+        a2d_stats_add (A2D_STAT_LOCALE_FALLBACKS, 1);
+    }
+
+    g_string_free (reader.member_name, TRUE);
+    g_mapped_file_unref (mapped_file);
+
+    file->name = reader.name;
+    file->comment = reader.comment;
+
+    a2d_stats_add (A2D_STAT_LOCALE_FILES_PARSED, 1);
+}
+
+static void
+parse_slice (gpointer data, gpointer user_data)
+{
+    A2DLocaleSlice *slice = data;
+    A2DLocaleJob *job = slice->job;
+    guint ii;
+
+    for (ii = slice->first; ii < slice->last; ii++)
+        parse_messages_file (g_ptr_array_index (job->files, ii),
+                             job->name_key, job->comment_key);
+
+    g_free (slice);
+
+    g_mutex_lock (&job->mutex);
+    if (--job->pending == 0)
+        g_cond_signal (&job->cond);
+    g_mutex_unlock (&job->mutex);
+}
+
+/*
+ * parse_files:
+ *
+ * Parses the files, many locales are split between the processors. The
+ * calling thread parses the last slice, the others go to the pool of the
+ * catalog. The pool is shared by the lookups running in parallel, so they
+ * don't start more threads than there are processors.
+ */
+static void
+parse_files (A2DLocaleCatalog *catalog, GPtrArray *files,
+             const gchar *name_key, const gchar *comment_key)
+{
+    A2DLocaleJob job;
+    guint n_threads;
+    guint slice_size;
+    guint ii;
+
+    if (!files->len)
+        return;
+
+    job.files = files;
+    job.name_key = name_key;
+    job.comment_key = comment_key;
+    g_mutex_init (&job.mutex);
+    g_cond_init (&job.cond);
+
+    n_threads = MIN (g_get_num_processors (),
+                     (files->len + FILES_PER_THREAD - 1) / FILES_PER_THREAD);
+
+    if (!catalog->pool)
+        n_threads = 1;
+
+    slice_size = (files->len + n_threads - 1) / n_threads;
+    job.pending = (files->len + slice_size - 1) / slice_size;
+
+    for (ii = 0; ii < files->len; ii += slice_size) {
+        A2DLocaleSlice *slice = g_new (A2DLocaleSlice, 1);
+
+        slice->job = &job;
+        slice->first = ii;
+        slice->last = MIN (ii + slice_size, files->len);
+
+        if (slice->last == files->len ||
+            !g_thread_pool_push (catalog->pool, slice, NULL))
+            parse_slice (slice, NULL);
+    }
+
+    /* Waits for the slices parsed in the pool */
+    g_mutex_lock (&job.mutex);
+    while (job.pending > 0)
+        g_cond_wait (&job.cond, &job.mutex);
+    g_mutex_unlock (&job.mutex);
+
+    g_cond_clear (&job.cond);
+    g_mutex_clear (&job.mutex);
+}
+
+/*
+ * is_locale_name:
+ *
+ * Locale directory names end up in keys of .desktop files, so only names
+ * like en, pt_BR or es_419 are accepted.
+ */
+static gboolean
+is_locale_name (const gchar *name)
+{
+    const gchar *pos;
+
+    if (!*name)
+        return FALSE;
+
+    for (pos = name; *pos; pos++) {
+        if (!g_ascii_isalnum (*pos) && *pos != '_' && *pos != '-' && *pos != '@')
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * lookup_cache:
+ *
+ * Fills the file from the cache, returns FALSE when it has to be parsed.
+ */
+static gboolean
+lookup_cache (A2DLocaleCatalog *catalog, A2DLocaleFile *file,
+              const gchar *name_key, const gchar *comment_key)
+{
+    A2DLocaleCacheEntry *entry = g_hash_table_lookup (catalog->cache, file->path);
+
+    if (!entry ||
+        entry->mtime != file->mtime ||
+        entry->size != file->size ||
+        g_strcmp0 (entry->name_key, name_key) != 0 ||
+        g_strcmp0 (entry->comment_key, comment_key) != 0)
+        return FALSE;
+
+    file->name = g_strdup (entry->name);
+    file->comment = g_strdup (entry->comment);
+
+    return TRUE;
+}
+
+/*
+ * store_cache:
+ */
+static void
+store_cache (A2DLocaleCatalog *catalog, A2DLocaleFile *file,
+             const gchar *name_key, const gchar *comment_key)
+{
+    A2DLocaleCacheEntry *entry = g_new (A2DLocaleCacheEntry, 1);
+
+    /* Entries of removed extension versions are never looked up again */
+    if (g_hash_table_size (catalog->cache) >= CACHE_MAX_ENTRIES)
+        g_hash_table_remove_all (catalog->cache);
+
+    entry->mtime = file->mtime;
+    entry->size = file->size;
+    entry->name_key = g_strdup (name_key);
+    entry->comment_key = g_strdup (comment_key);
+    entry->name = g_strdup (file->name);
+    entry->comment = g_strdup (file->comment);
+
+    g_hash_table_replace (catalog->cache, g_strdup (file->path), entry);
+}
+
+static gint
+compare_files (gconstpointer a, gconstpointer b)
+{
+    return strcmp ((*(A2DLocaleFile **) a)->locale, (*(A2DLocaleFile **) b)->locale);
+}
+
+/*
+ * a2d_locale_catalog_new:
+ */
+A2DLocaleCatalog *
+a2d_locale_catalog_new (void)
+{
+    A2DLocaleCatalog *catalog = g_new0 (A2DLocaleCatalog, 1);
+
+    g_mutex_init (&catalog->mutex);
+    catalog->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, cache_entry_free);
+
+    /* Threads are started when the first lookup needs them */
+    if (g_get_num_processors () > 1)
+        catalog->pool = g_thread_pool_new (parse_slice, NULL, g_get_num_processors (),
+                                           FALSE, NULL);
+
+    return catalog;
+}
+
+/*
+ * a2d_locale_catalog_free:
+ */
+void
+a2d_locale_catalog_free (A2DLocaleCatalog *catalog)
+{
+    if (!catalog)
+        return;
+
+    if (catalog->pool)
+        g_thread_pool_free (catalog->pool, FALSE, TRUE);
+
+    g_hash_table_destroy (catalog->cache);
+    g_mutex_clear (&catalog->mutex);
+    g_free (catalog);
+}
+
+/*
+ * a2d_locale_catalog_get:
+ *
+ * Returns localizations of app from the _locales directory of the extension
+ * sorted by locale. Only the locales listed in locales are read, when it's
+ * not NULL. Files not changed since the last lookup are not read at all.
+ */
+GPtrArray *
+a2d_locale_catalog_get (A2DLocaleCatalog *catalog, const gchar *locales_directory,
+                        const gchar *name_key, const gchar *comment_key,
+                        const gchar * const *locales)
+{
+    GPtrArray *localizations = g_ptr_array_new_with_free_func (localization_free);
+    GPtrArray *files, *misses;
+    const gchar *locale;
+    GDir *dir;
+    guint ii;
+    gint64 lookup_start = a2d_stats_get_time_ns ();
+
+    dir = g_dir_open (locales_directory, 0, NULL);
+    if (!dir)
+        return localizations;
+
+    files = g_ptr_array_new_with_free_func (locale_file_free);
+    misses = g_ptr_array_new ();
+
+    while ((locale = g_dir_read_name (dir))) {
+        A2DLocaleFile *file;
+        GStatBuf stat_buf;
+        gboolean cached;
+        gchar *path;
+
+        if (!is_locale_name (locale))
+            continue;
+
+        if (locales && !g_strv_contains (locales, locale))
+            continue;
+
+        path = g_build_filename (locales_directory, locale, MESSAGES_FILE, NULL);
+
+        if (g_stat (path, &stat_buf)) {
+            g_free (path);
+            continue;
+        }
+
+        file = g_new0 (A2DLocaleFile, 1);
+        file->locale = g_strdup (locale);
+        file->path = path;
+        file->mtime = stat_buf.st_mtime;
+        file->size = stat_buf.st_size;
+
+        g_mutex_lock (&catalog->mutex);
+        cached = lookup_cache (catalog, file, name_key, comment_key);
+        g_mutex_unlock (&catalog->mutex);
+
+        if (cached)
+            a2d_stats_add (A2D_STAT_LOCALE_CACHE_HITS, 1);
+        else
+            g_ptr_array_add (misses, file);
+
+        g_ptr_array_add (files, file);
+    }
+
+    g_dir_close (dir);
+
+    parse_files (catalog, misses, name_key, comment_key);
+
+    g_mutex_lock (&catalog->mutex);
+    for (ii = 0; ii < misses->len; ii++)
+        store_cache (catalog, g_ptr_array_index (misses, ii), name_key, comment_key);
+    g_mutex_unlock (&catalog->mutex);
+
+    g_ptr_array_sort (files, compare_files);
+
+    for (ii = 0; ii < files->len; ii++) {
+        A2DLocaleFile *file = g_ptr_array_index (files, ii);
+        A2DLocalization *localization;
+
+        if (!file->name && !file->comment)
+            continue;
+
+        localization = g_new (A2DLocalization, 1);
+        localization->locale = file->locale;
+        localization->name = file->name;
+        localization->comment = file->comment;
+        file->locale = file->name = file->comment = NULL;
+
+        g_ptr_array_add (localizations, localization);
+    }
+
+    g_ptr_array_free (misses, TRUE);
+    g_ptr_array_free (files, TRUE);
+
+    a2d_stats_add (A2D_STAT_LOCALE_NSEC, a2d_stats_get_time_ns () - lookup_start);
+
+    return localizations;
+}
+
+/*
+ * a2d_locale_get_message_key:
+ *
+ * Returns name of the message referenced by __MSG_name__ placeholder in the
+ * manifest value or NULL when the value is not a placeholder.
+ */
+gchar *
+a2d_locale_get_message_key (const gchar *value)
+{
+    gsize length = value ? strlen (value) : 0;
+
+    if (length <= strlen (MESSAGE_PREFIX) + strlen (MESSAGE_SUFFIX) ||
+        !g_str_has_prefix (value, MESSAGE_PREFIX) ||
+        !g_str_has_suffix (value, MESSAGE_SUFFIX))
+        return NULL;
+
+    return g_strndup (value + strlen (MESSAGE_PREFIX),
+                      length - strlen (MESSAGE_PREFIX) - strlen (MESSAGE_SUFFIX));
+}
@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#ifndef __A2D_LOCALE_H
+#define __A2D_LOCALE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Localized strings of app in one locale */
+typedef struct {
+	gchar		*locale;
+	gchar		*name;
+	gchar		*comment;
+} A2DLocalization;
+
+typedef struct A2DLocaleCatalog A2DLocaleCatalog;
+
+A2DLocaleCatalog *
+		a2d_locale_catalog_new			(void);
+void		a2d_locale_catalog_free			(A2DLocaleCatalog *catalog);
+GPtrArray *	a2d_locale_catalog_get			(A2DLocaleCatalog *catalog,
+							 const gchar *locales_directory,
+							 const gchar *name_key,
+							 const gchar *comment_key,
+							 const gchar * const *locales);
+gchar *		a2d_locale_get_message_key		(const gchar *value);
+
+G_END_DECLS
+
+#endif /* __A2D_LOCALE_H */
@@ -79,14 +79,25 @@ a2d_main_newp (NPMIMEType pluginType, NPP instance, uint16_t mode,
 	int16_t argc, char *argn[], char *argv[], NPSavedData *saved)
 {
 	bool bWindowed = false;
+	gboolean prewarm = TRUE;
 	A2DPlugin *plugin;
+	int16_t ii;
 
 	if (instance == NULL)
 		return NPERR_INVALID_INSTANCE_ERROR;
 
 	npnfuncs->setvalue (instance, NPPVpluginWindowBool, (void *) bWindowed);
 
-	plugin = A2D_PLUGIN (a2d_plugin_new ());
+	/* <embed prewarm="false"> defers the setup to the first call */
+	for (ii = 0; ii < argc; ii++) {
+		if (g_strcmp0 (argn[ii], "prewarm") == 0 &&
+		    g_strcmp0 (argv[ii], "false") == 0)
+			prewarm = FALSE;
+	}
+
+	a2d_plugin_prewarm (prewarm);
+
+	plugin = A2D_PLUGIN (a2d_plugin_new (instance));
 
 	instance->pdata = plugin;
 
@@ -163,6 +174,7 @@ NP_Initialize (NPNetscapeFuncs *npnf, NPPluginFuncs *nppfuncs)
 		return NPERR_INCOMPATIBLE_VERSION_ERROR;
 
 	npnfuncs = npnf;
+	a2d_plugin_set_np_netscape_functions (npnfuncs);
 	NP_GetEntryPoints (nppfuncs);
 	return NPERR_NO_ERROR;
 }
@@ -173,6 +185,8 @@ NP_Initialize (NPNetscapeFuncs *npnf, NPPluginFuncs *nppfuncs)
 NPError
 NP_Shutdown ()
 {
+	a2d_plugin_shutdown ();
+
 	return NPERR_NO_ERROR;
 }
 
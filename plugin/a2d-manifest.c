@@ -0,0 +1,277 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "a2d-json.h"
+#include "a2d-manifest.h"
+#include "a2d-stats.h"
+
+static void
+icon_free (gpointer data)
+{
+    A2DManifestIcon *icon = data;
+
+    g_free (icon->size);
+    g_free (icon->filename);
+    g_free (icon);
+}
+
+static void
+add_icon (A2DManifest *manifest, const gchar *size, const gchar *filename)
+{
+    A2DManifestIcon *icon = g_new (A2DManifestIcon, 1);
+
+    icon->size = g_strdup (size);
+    icon->filename = g_strdup (filename);
+
+    g_ptr_array_add (manifest->icons, icon);
+}
+
+static A2DManifest *
+manifest_new ()
+{
+    A2DManifest *manifest = g_new0 (A2DManifest, 1);
+
+    manifest->icons = g_ptr_array_new_with_free_func (icon_free);
+
+    return manifest;
+}
+
+static gboolean
+read_icon (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    A2DManifest *manifest = user_data;
+    GString *filename;
+    gboolean ret_val;
+
+    if (a2d_json_peek (scanner) != '"')
+        return a2d_json_skip_value (scanner);
+
+    filename = g_string_new (NULL);
+
+    ret_val = a2d_json_read_string (scanner, filename);
+    if (ret_val)
+        add_icon (manifest, name->str, filename->str);
+
+    g_string_free (filename, TRUE);
+
+    return ret_val;
+}
+
+/*
+ * read_string_member:
+ *
+ * Reads string value into the member, values of other types are skipped.
+ */
+static gboolean
+read_string_member (A2DJsonScanner *scanner, gchar **member)
+{
+    GString *value;
+
+    if (a2d_json_peek (scanner) != '"')
+        return a2d_json_skip_value (scanner);
+
+    value = g_string_new (NULL);
+    if (!a2d_json_read_string (scanner, value)) {
+        g_string_free (value, TRUE);
+
+        return FALSE;
+    }
+
+    g_free (*member);
+    *member = g_string_free (value, FALSE);
+
+    return TRUE;
+}
+
+static gboolean
+read_manifest_member (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    A2DManifest *manifest = user_data;
+
+    if (strcmp (name->str, "name") == 0)
+        return read_string_member (scanner, &manifest->name);
+
+    if (strcmp (name->str, "description") == 0)
+        return read_string_member (scanner, &manifest->description);
+
+    if (strcmp (name->str, "offline_enabled") == 0)
+        return a2d_json_read_boolean (scanner, &manifest->offline_enabled);
+
+    if (strcmp (name->str, "icons") == 0) {
+        gboolean ret_val;
+
+        if (a2d_json_peek (scanner) != '{')
+            return a2d_json_skip_value (scanner);
+
+        /* The last occurrence wins */
+        g_ptr_array_set_size (manifest->icons, 0);
+
+        name = g_string_new (NULL);
+        ret_val = a2d_json_read_object (scanner, name, read_icon, manifest);
+        g_string_free (name, TRUE);
+
+        return ret_val;
+    }
+
+    return a2d_json_skip_value (scanner);
+}
+
+/*
+ * load_streaming:
+ *
+ * Extracts needed keys in one pass over the mapped manifest, values of the
+ * other keys are skipped without being parsed.
+ */
+static A2DManifest *
+load_streaming (const gchar *contents, gsize length)
+{
+    A2DJsonScanner scanner;
+    A2DManifest *manifest = manifest_new ();
+    GString *name = g_string_new (NULL);
+    gboolean success;
+
+    a2d_json_scanner_init (&scanner, contents, length);
+
+    success = a2d_json_read_object (&scanner, name, read_manifest_member, manifest) &&
+              a2d_json_is_at_end (&scanner);
+
+    g_string_free (name, TRUE);
+
+    if (!success) {
+        a2d_manifest_free (manifest);
+
+        return NULL;
+    }
+
+    return manifest;
+}
+
+/*
+ * load_json_glib:
+ *
+ * Loads manifest through json-glib, used when the streaming reader doesn't
+ * understand the file.
+ */
+static A2DManifest *
+load_json_glib (const gchar *contents, gsize length)
+{
+    JsonParser *parser = json_parser_new ();
+    JsonReader *reader;
+    A2DManifest *manifest;
+
+    if (!json_parser_load_from_data (parser, contents, length, NULL)) {
+        g_object_unref (parser);
+
+        return NULL;
+    }
+
+    manifest = manifest_new ();
+    reader = json_reader_new (json_parser_get_root (parser));
+
+    if (json_reader_read_member (reader, "name") && json_reader_is_value (reader))
+        manifest->name = g_strdup (json_reader_get_string_value (reader));
+
+    json_reader_end_member (reader);
+
+    if (json_reader_read_member (reader, "description") && json_reader_is_value (reader))
+        manifest->description = g_strdup (json_reader_get_string_value (reader));
+
+    json_reader_end_member (reader);
+
+    if (json_reader_read_member (reader, "offline_enabled"))
+        manifest->offline_enabled = json_reader_get_boolean_value (reader);
+
+    json_reader_end_member (reader);
+
+    if (json_reader_read_member (reader, "icons") && json_reader_is_object (reader)) {
+        gchar **sizes = json_reader_list_members (reader);
+        gint ii;
+
+        for (ii = 0; sizes && sizes[ii]; ii++) {
+            if (json_reader_read_member (reader, sizes[ii]) && json_reader_is_value (reader))
+                add_icon (manifest, sizes[ii], json_reader_get_string_value (reader));
+
+            json_reader_end_member (reader);
+        }
+
+        g_strfreev (sizes);
+    }
+
+    json_reader_end_member (reader);
+
+    g_object_unref (reader);
+    g_object_unref (parser);
+
+    return manifest;
+}
+
+/*
+ * a2d_manifest_load:
+ *
+ * Loads keys we need from the extension manifest. Returns NULL when the file
+ * can't be read or parsed.
+ */
+A2DManifest *
+a2d_manifest_load (const gchar *filename)
+{
+    GMappedFile *mapped_file;
+    A2DManifest *manifest;
+    const gchar *contents;
+    gsize length;
+    gint64 load_start = a2d_stats_get_time_ns ();
+
+    mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+    if (!mapped_file)
+        return NULL;
+
+    contents = g_mapped_file_get_contents (mapped_file);
+    length = g_mapped_file_get_length (mapped_file);
+
+    manifest = load_streaming (contents, length);
+    if (!manifest) {
+        manifest = load_json_glib (contents, length);
+        a2d_stats_add (A2D_STAT_MANIFEST_FALLBACKS, 1);
+    }
+
+    g_mapped_file_unref (mapped_file);
+
+    a2d_stats_add (A2D_STAT_MANIFEST_LOADS, 1);
+    a2d_stats_add (A2D_STAT_MANIFEST_NSEC, a2d_stats_get_time_ns () - load_start);
+
+    return manifest;
+}
+
+void
+a2d_manifest_free (A2DManifest *manifest)
+{
+    if (!manifest)
+        return;
+
+    g_ptr_array_free (manifest->icons, TRUE);
+    g_free (manifest->name);
+    g_free (manifest->description);
+    g_free (manifest);
+}
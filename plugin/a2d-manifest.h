@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_MANIFEST_H
+#define __A2D_MANIFEST_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct {
+	gchar *size;
+	gchar *filename;
+} A2DManifestIcon;
+
+typedef struct {
+	gchar *name;			/* may be __MSG_key__ placeholder */
+	gchar *description;
+	gboolean offline_enabled;
+	GPtrArray *icons;		/* A2DManifestIcon */
+} A2DManifest;
+
+A2DManifest *	a2d_manifest_load			(const gchar *filename);
+void		a2d_manifest_free			(A2DManifest *manifest);
+
+G_END_DECLS
+
+#endif /* __A2D_MANIFEST_H */
@@ -0,0 +1,129 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <glib.h>
+
+#include "a2d-operation.h"
+
+/* Fits strings of a typical app */
+#define STRINGS_BLOCK_SIZE 256
+
+/*
+ * a2d_operation_type_from_string:
+ *
+ * Returns operation type for the given operation name ("add", "remove",
+ * "enable" or "disable").
+ */
+A2DOperationType
+a2d_operation_type_from_string (const gchar *type)
+{
+    if (g_strcmp0 (type, "add") == 0)
+        return A2D_OPERATION_ADD;
+    if (g_strcmp0 (type, "remove") == 0)
+        return A2D_OPERATION_REMOVE;
+    if (g_strcmp0 (type, "enable") == 0)
+        return A2D_OPERATION_ENABLE;
+    if (g_strcmp0 (type, "disable") == 0)
+        return A2D_OPERATION_DISABLE;
+
+    return A2D_OPERATION_INVALID;
+}
+
+/*
+ * a2d_operation_new:
+ *
+ * Creates new operation of given type for app with given id.
+ */
+A2DOperation *
+a2d_operation_new (A2DOperationType type, const gchar *app_id)
+{
+    A2DOperation *operation = g_new0 (A2DOperation, 1);
+
+    operation->strings = a2d_arena_new (STRINGS_BLOCK_SIZE);
+    operation->type = type;
+    operation->app_id = a2d_arena_strdup (operation->strings, app_id);
+    operation->app_enabled = TRUE;
+
+    return operation;
+}
+
+/*
+ * a2d_operation_free:
+ */
+void
+a2d_operation_free (A2DOperation *operation)
+{
+    if (!operation)
+        return;
+
+    a2d_arena_free (operation->strings);
+    g_free (operation);
+}
+
+/*
+ * a2d_operation_copy_string:
+ *
+ * Returns copy of at most length bytes of string, which lives as long as the
+ * operation.
+ */
+gchar *
+a2d_operation_copy_string (A2DOperation *operation, const gchar *string, gsize length)
+{
+    return a2d_arena_strndup (operation->strings, string, length);
+}
+
+/*
+ * a2d_operation_merge:
+ *
+ * Merges the next operation of the same app into operation, so it has the net
+ * effect of both of them (e.g. add followed by disable is add of disabled app,
+ * add followed by remove is remove). Returns FALSE when they can't be merged.
+ */
+gboolean
+a2d_operation_merge (A2DOperation *operation, const A2DOperation *next)
+{
+    switch (next->type) {
+    case A2D_OPERATION_ADD:
+        /* Add replaces whatever was there */
+        operation->type = A2D_OPERATION_ADD;
+        operation->app_name = a2d_arena_strdup (operation->strings, next->app_name);
+        operation->app_version = a2d_arena_strdup (operation->strings, next->app_version);
+        operation->app_launch_url = a2d_arena_strdup (operation->strings, next->app_launch_url);
+        operation->app_enabled = next->app_enabled;
+        return TRUE;
+    case A2D_OPERATION_REMOVE:
+        operation->type = A2D_OPERATION_REMOVE;
+        return TRUE;
+    case A2D_OPERATION_ENABLE:
+    case A2D_OPERATION_DISABLE:
+        /* Removed app has nothing to enable */
+        if (operation->type == A2D_OPERATION_REMOVE)
+            return FALSE;
+
+        if (operation->type == A2D_OPERATION_ADD)
+            operation->app_enabled = next->type == A2D_OPERATION_ENABLE;
+        else
+            operation->type = next->type;
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
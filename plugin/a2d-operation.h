@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __A2D_OPERATION_H
+#define __A2D_OPERATION_H
+
+#include <glib.h>
+
+#include "a2d-arena.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+	A2D_OPERATION_INVALID,
+	A2D_OPERATION_ADD,
+	A2D_OPERATION_REMOVE,
+	A2D_OPERATION_ENABLE,
+	A2D_OPERATION_DISABLE
+} A2DOperationType;
+
+typedef struct
+{
+	A2DOperationType	 type;
+	gchar			*app_name;
+	gchar			*app_id;
+	gchar			*app_version;
+	gchar			*app_launch_url;
+	gboolean		 app_enabled;
+	/* NPObject notified about the result of asynchronous operation */
+	gpointer		 callback;
+	/* when asynchronous operation was queued (see a2d_stats_get_time_ns) */
+	gint64			 queued_time;
+	/* holds the strings above, they are freed together with the operation */
+	A2DArena		*strings;
+} A2DOperation;
+
+A2DOperationType	a2d_operation_type_from_string	(const gchar *type);
+A2DOperation *		a2d_operation_new		(A2DOperationType type,
+							 const gchar *app_id);
+void			a2d_operation_free		(A2DOperation *operation);
+gchar *			a2d_operation_copy_string	(A2DOperation *operation,
+							 const gchar *string,
+							 gsize length);
+gboolean		a2d_operation_merge		(A2DOperation *operation,
+							 const A2DOperation *next);
+
+G_END_DECLS
+
+#endif /* __A2D_OPERATION_H */
@@ -0,0 +1,280 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <glib.h>
+#include <string.h>
+
+#include "a2d-paths.h"
+#include "a2d-stats.h"
+
+#define USER_DATA_DIR_APPLICATIONS "/applications/"
+#define USER_DATA_DIR_ICONS "/icons/hicolor/"
+#define USER_DATA_DIR_APPS2DESKTOP "/apps2desktop/"
+#define CHROME_PROFILE_PATH "/google-chrome/Default/"
+#define CHROMIUM_PROFILE_PATH "/chromium/Default/"
+#define EXTENSIONS_DIRECTORY "Extensions/"
+#define PREFERENCES_FILE "Preferences"
+#define DESKTOP_SUFFIX ".desktop"
+#define CACHE_MAX_ENTRIES 4096
+
+/* Interned names of one app */
+typedef struct {
+    const gchar		*generated_name;
+    const gchar		*desktop_path;
+} A2DPathsEntry;
+
+/*
+ * Directories are built once for the plugin instance and names of apps are
+ * interned, so the returned strings are views valid until a2d_paths_free and
+ * they mustn't be freed by callers.
+ */
+struct A2DPaths
+{
+    gchar		*applications_directory;
+    gsize		 applications_directory_length;
+    gchar		*icon_directory;
+    gchar		*data_directory;
+    gchar		*extensions_directory;
+    gchar		*preferences_file;
+    gchar		*app_prefix;
+    /* protects interned names, they are looked up from the worker too */
+    GMutex		 mutex;
+    GHashTable		*entries;
+    GStringChunk	*strings;
+};
+
+/*
+ * a2d_paths_new:
+ *
+ * Builds directories of the user, Chrome and Chromium have different
+ * profiles.
+ */
+A2DPaths *
+a2d_paths_new (gboolean chromium)
+{
+    A2DPaths *paths = g_new0 (A2DPaths, 1);
+    gchar *profile_directory = g_strconcat (
+        g_get_user_config_dir (),
+        chromium ? CHROMIUM_PROFILE_PATH : CHROME_PROFILE_PATH,
+        NULL);
+
+    paths->applications_directory = g_strconcat (
+        g_get_user_data_dir (), USER_DATA_DIR_APPLICATIONS, NULL);
+    paths->applications_directory_length = strlen (paths->applications_directory);
+    paths->icon_directory = g_strconcat (
+        g_get_user_data_dir (), USER_DATA_DIR_ICONS, NULL);
+    paths->data_directory = g_strconcat (
+        g_get_user_data_dir (), USER_DATA_DIR_APPS2DESKTOP, NULL);
+    paths->extensions_directory = g_strconcat (profile_directory, EXTENSIONS_DIRECTORY, NULL);
+    paths->preferences_file = g_strconcat (profile_directory, PREFERENCES_FILE, NULL);
+
+    g_free (profile_directory);
+
+    g_mutex_init (&paths->mutex);
+    paths->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+    paths->strings = g_string_chunk_new (4096);
+
+    return paths;
+}
+
+/*
+ * a2d_paths_free:
+ */
+void
+a2d_paths_free (A2DPaths *paths)
+{
+    if (!paths)
+        return;
+
+    g_hash_table_destroy (paths->entries);
+    g_string_chunk_free (paths->strings);
+    g_mutex_clear (&paths->mutex);
+    g_free (paths->applications_directory);
+    g_free (paths->icon_directory);
+    g_free (paths->data_directory);
+    g_free (paths->extensions_directory);
+    g_free (paths->preferences_file);
+    g_free (paths->app_prefix);
+    g_free (paths);
+}
+
+/*
+ * a2d_paths_set_app_prefix:
+ *
+ * Sets the prefix of generated names (NULL for none). Names interned with the
+ * previous prefix are forgotten, but their strings stay valid.
+ */
+void
+a2d_paths_set_app_prefix (A2DPaths *paths, const gchar *app_prefix)
+{
+    g_mutex_lock (&paths->mutex);
+
+    g_free (paths->app_prefix);
+    paths->app_prefix = g_strdup (app_prefix);
+    g_hash_table_remove_all (paths->entries);
+
+    g_mutex_unlock (&paths->mutex);
+}
+
+/*
+ * a2d_paths_get_applications_directory:
+ */
+const gchar *
+a2d_paths_get_applications_directory (A2DPaths *paths)
+{
+    return paths->applications_directory;
+}
+
+/*
+ * a2d_paths_get_icon_directory:
+ */
+const gchar *
+a2d_paths_get_icon_directory (A2DPaths *paths)
+{
+    return paths->icon_directory;
+}
+
+/*
+ * a2d_paths_get_data_directory:
+ *
+ * Returns directory with our own data (indexes and caches).
+ */
+const gchar *
+a2d_paths_get_data_directory (A2DPaths *paths)
+{
+    return paths->data_directory;
+}
+
+/*
+ * a2d_paths_get_extensions_directory:
+ */
+const gchar *
+a2d_paths_get_extensions_directory (A2DPaths *paths)
+{
+    return paths->extensions_directory;
+}
+
+/*
+ * a2d_paths_get_preferences_file:
+ */
+const gchar *
+a2d_paths_get_preferences_file (A2DPaths *paths)
+{
+    return paths->preferences_file;
+}
+
+/*
+ * a2d_paths_get_desktop_filename:
+ *
+ * Returns file name part of path in the applications directory.
+ */
+const gchar *
+a2d_paths_get_desktop_filename (A2DPaths *paths, const gchar *desktop_path)
+{
+    return desktop_path + paths->applications_directory_length;
+}
+
+/*
+ * build_generated_name:
+ */
+static gchar *
+build_generated_name (A2DPaths *paths, const gchar *app_id, A2DArena *arena)
+{
+    if (!paths->app_prefix)
+        return a2d_arena_strconcat (arena, "a2d-", app_id, NULL);
+
+    return a2d_arena_strconcat (arena, "a2d-", app_id, "-", paths->app_prefix, NULL);
+}
+
+/*
+ * lookup_entry:
+ *
+ * Returns interned names of the app, they are built on the first lookup.
+ * When the cache is full (ids come from JavaScript, so there is no limit of
+ * them) the names are built in the arena and the returned entry lives there
+ * too.
+ */
+static const A2DPathsEntry *
+lookup_entry (A2DPaths *paths, const gchar *app_id, A2DArena *arena)
+{
+    A2DPathsEntry *entry;
+    gchar *generated_name, *desktop_path;
+
+    g_mutex_lock (&paths->mutex);
+
+    entry = g_hash_table_lookup (paths->entries, app_id);
+    if (entry) {
+        g_mutex_unlock (&paths->mutex);
+        a2d_stats_add (A2D_STAT_PATH_CACHE_HITS, 1);
+        return entry;
+    }
+
+    generated_name = build_generated_name (paths, app_id, arena);
+    desktop_path = a2d_arena_strconcat (
+        arena, paths->applications_directory, generated_name, DESKTOP_SUFFIX, NULL);
+
+    if (g_hash_table_size (paths->entries) >= CACHE_MAX_ENTRIES) {
+        g_mutex_unlock (&paths->mutex);
+
+        entry = a2d_arena_alloc (arena, sizeof (A2DPathsEntry));
+        entry->generated_name = generated_name;
+        entry->desktop_path = desktop_path;
+
+        return entry;
+    }
+
+    entry = g_new (A2DPathsEntry, 1);
+    entry->generated_name = g_string_chunk_insert (paths->strings, generated_name);
+    entry->desktop_path = g_string_chunk_insert (paths->strings, desktop_path);
+    g_hash_table_insert (paths->entries,
+                         g_string_chunk_insert (paths->strings, app_id), entry);
+
+    g_mutex_unlock (&paths->mutex);
+
+    a2d_stats_add (A2D_STAT_PATHS_INTERNED, 1);
+
+    return entry;
+}
+
+/*
+ * a2d_paths_get_generated_name:
+ *
+ * Returns name of files generated for the app (without the suffix). The
+ * arena is used only for temporary strings.
+ */
+const gchar *
+a2d_paths_get_generated_name (A2DPaths *paths, const gchar *app_id, A2DArena *arena)
+{
+    return lookup_entry (paths, app_id, arena)->generated_name;
+}
+
+/*
+ * a2d_paths_get_desktop_path:
+ *
+ * Returns .desktop file path of the app.
+ */
+const gchar *
+a2d_paths_get_desktop_path (A2DPaths *paths, const gchar *app_id, A2DArena *arena)
+{
+    return lookup_entry (paths, app_id, arena)->desktop_path;
+}
@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#ifndef __A2D_PATHS_H
+#define __A2D_PATHS_H
+
+#include <glib.h>
+
+#include "a2d-arena.h"
+
+G_BEGIN_DECLS
+
+typedef struct A2DPaths A2DPaths;
+
+A2DPaths *	a2d_paths_new				(gboolean chromium);
+void		a2d_paths_free				(A2DPaths *paths);
+void		a2d_paths_set_app_prefix		(A2DPaths *paths,
+							 const gchar *app_prefix);
+const gchar *	a2d_paths_get_applications_directory	(A2DPaths *paths);
+const gchar *	a2d_paths_get_icon_directory		(A2DPaths *paths);
+const gchar *	a2d_paths_get_data_directory		(A2DPaths *paths);
+const gchar *	a2d_paths_get_extensions_directory	(A2DPaths *paths);
+const gchar *	a2d_paths_get_preferences_file		(A2DPaths *paths);
+const gchar *	a2d_paths_get_desktop_filename		(A2DPaths *paths,
+							 const gchar *desktop_path);
+const gchar *	a2d_paths_get_generated_name		(A2DPaths *paths,
+							 const gchar *app_id,
+							 A2DArena *arena);
+const gchar *	a2d_paths_get_desktop_path		(A2DPaths *paths,
+							 const gchar *app_id,
+							 A2DArena *arena);
+
+G_END_DECLS
+
+#endif /* __A2D_PATHS_H */
@@ -22,43 +22,244 @@
 
 #include <glib.h>
 #include <glib-object.h>
-#include <json-glib/json-glib.h>
 #include <glib/gstdio.h>
 #include <time.h>
 #include <utime.h>
 #include <sys/types.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "a2d-plugin.h"
+#include "a2d-operation.h"
+#include "a2d-worker.h"
+#include "a2d-index.h"
+#include "a2d-stats.h"
+#include "a2d-dir-index.h"
+#include "a2d-desktop-scan.h"
+#include "a2d-hash.h"
+#include "a2d-manifest.h"
+#include "a2d-extension-resolver.h"
+#include "a2d-commit.h"
+#include "a2d-icon-cache.h"
+#include "a2d-icon.h"
+#include "a2d-desktop-entry.h"
+#include "a2d-locale.h"
+#include "a2d-arena.h"
+#include "a2d-paths.h"
+#include "a2d-pool.h"
+#include "a2d-preferences.h"
 
 #define A2D_PLUGIN_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), A2D_TYPE_PLUGIN, A2DPluginPrivate))
 
+/* Plugin instance the results of asynchronous operations are delivered to.
+ * Instance is unset when the plugin is destroyed. */
+typedef struct
+{
+    gint		 ref_count;
+    NPP			 instance;
+} A2DAsyncTarget;
+
+/* Operations processed in time slices on the plugin thread, when threads
+ * can't be used. Slice scheduled after the plugin is destroyed frees it. */
+typedef struct
+{
+    A2DAsyncTarget	*target;
+    GQueue		 operations;
+    GQueue		 syncs;
+    gboolean		 scheduled;
+} A2DSlicer;
+
 struct A2DPluginPrivate
 {
     NPP			pNPInstance;
     NPObject		*pScriptableObject;
+    A2DWorker		*worker;
+    A2DSlicer		*slicer;
+    A2DAsyncTarget	*async_target;
 };
 
 G_DEFINE_TYPE (A2DPlugin, a2d_plugin, G_TYPE_OBJECT)
 
+/* Scriptable object remembers the instance it was created for, so we are
+ * able to create JavaScript objects (e.g. arrays) as results */
+typedef struct
+{
+    NPObject		 object;
+    NPP			 instance;
+} A2DScriptableObject;
+
+/* Shared state of operations executed together (see applyBatch) */
+typedef struct
+{
+    const gchar		*applications_directory;
+    const gchar		*icon_directory;
+    GHashTable		*changed_icon_directories;
+    GHashTable		*app_ids;	/* apps the operations were run for */
+    A2DCommit		*commit;
+    /* temporary strings of the running operation */
+    A2DArena		*arena;
+} A2DBatch;
+
+/* Icon from the manifest with its real size, which is 0 when it's not
+ * a square PNG image */
+typedef struct
+{
+    gchar		*path;
+    guint		 size;
+} A2DIconSource;
+
+/* Operations done by sync */
+typedef struct
+{
+    gint		 created;
+    gint		 updated;
+    gint		 removed;
+    gint		 skipped;
+    gint		 failed;
+    gint		 superseded;	/* apps handled by the user meanwhile */
+} A2DSyncResult;
+
+/* Sync of all apps, the asynchronous one runs as a bulk job of the worker or
+ * in slices */
+typedef struct
+{
+    GPtrArray		*operations;	/* adds of the listed apps */
+    A2DSyncResult	 result;
+    A2DWorker		*worker;	/* NULL unless run by the worker */
+    A2DAsyncTarget	*target;
+    NPObject		*callback;
+    GPtrArray		*pending;	/* updates followed by removals */
+    gboolean		*results;
+    gboolean		*superseded;
+    /* apps the user's operations were run for since the sync was prepared */
+    GHashTable		*handled;
+    guint		 n_updates;
+    guint		 next;		/* next pending to run */
+    guint		 batch_start;	/* first pending run in the current batch */
+} A2DSyncJob;
+
+/* Result of asynchronous operation waiting to be delivered */
+typedef struct
+{
+    A2DAsyncTarget	*target;
+    A2DOperation	*operation;
+    gboolean		 success;
+} A2DCompletion;
+
+/* Steps of adding app, the pool runs them as separate tasks */
+typedef enum {
+    ADD_STEP_RESOLVE,
+    ADD_STEP_MANIFEST,
+    ADD_STEP_DESKTOP_ENTRY,
+    ADD_STEP_ICONS,
+    ADD_STEP_DONE
+} A2DAddStep;
+
+/* State of app being added, which is passed between the steps */
+typedef struct
+{
+    A2DBatch		*batch;
+    const A2DOperation	*operation;
+    A2DAddStep		 step;
+    gboolean		 ret_val;
+    gchar		*extension_directory;
+    const gchar		*desktop_file_filename;
+    const gchar		*generated_app_name;
+    gchar		*manifest_file_path;
+    A2DIndexRecord	 record;
+    A2DIndexRecord	 old_record;
+    gboolean		 indexed;
+    A2DManifest		*manifest;
+    GPtrArray		*icon_sources;
+    guint16		 kept_icons;
+} A2DAddJob;
+
+/* Operation run by the pool. The batch is shared with the other operations,
+ * except for the arena. */
+typedef struct
+{
+    A2DBatch		 batch;
+    const A2DOperation	*operation;
+    gboolean		 started;
+    A2DAddJob		 add_job;
+    gboolean		*result;
+} A2DOperationTask;
+
 #define METHOD_DISABLE "disable"
 #define METHOD_ENABLE "enable"
 #define METHOD_ADD "add"
 #define METHOD_REMOVE "remove"
+#define METHOD_APPLY_BATCH "applyBatch"
+#define METHOD_SYNC "sync"
+
+#define PROPERTY_QUEUE_DEPTH "queueDepth"
+#define PROPERTY_STATS "stats"
+#define PROPERTY_DURABILITY "durability"
+#define PROPERTY_SYSTEM_LOCALES_ONLY "systemLocalesOnly"
+#define PROPERTY_THREADS "threads"
+#define PROPERTY_COOPERATIVE "cooperative"
+
+#define STATUS_OK "ok"
+#define STATUS_FAILED "failed"
+#define STATUS_INVALID "invalid"
+
+#define WORKER_QUEUE_DEPTH 512
+/* Milliseconds for which events of the browser are collected */
+#define WORKER_WINDOW 50
+#define MAX_POOL_THREADS 8
+/* milliseconds of one slice of the cooperative processing */
+#define SLICE_BUDGET 4
 
-#define CHROME_EXTENSIONS_PATH "/google-chrome/Default/Extensions/"
-#define CHROMIUM_EXTENSIONS_PATH "/chromium/Default/Extensions/"
-#define USER_DATA_DIR_APPLICATIONS "/applications/"
-#define USER_DATA_DIR_ICONS "/icons/hicolor/"
 #define MANIFEST_FILE "manifest.json"
+#define LOCALES_DIRECTORY "_locales/"
+#define ARENA_BLOCK_SIZE 4096
 
 #define CHROME "Chrome"
 #define CHROMIUM "Chromium"
 
 static NPNetscapeFuncs *npnfuncs = NULL;
+static NPIdentifier length_identifier = NULL;
 static gboolean running_chromium = FALSE;
 static gchar* app_prefix = NULL;
-static const gchar* executable = NULL;
+static gchar* executable = NULL;
+static A2DIndex *app_index = NULL;
+static A2DDirIndex *applications_index = NULL;
+static A2DExtensionResolver *extension_resolver = NULL;
+static gint durability = A2D_DURABILITY_FSYNC;
+static A2DIconCache *icon_cache = NULL;
+static A2DLocaleCatalog *locale_catalog = NULL;
+static A2DPaths *paths = NULL;
+static A2DPool *pool = NULL;
+static guint pool_size = 0;
+/* 0 for the number of processors */
+static gint threads = 0;
+static gint system_locales_only = FALSE;
+/* Process operations on the plugin thread instead of threads */
+static gint cooperative = FALSE;
+
+/* Shared state is initialized once, in the background when the plugin is
+ * loaded or on the first invoke */
+typedef enum {
+    INIT_NONE,
+    INIT_RUNNING,
+    INIT_DONE
+} A2DInitState;
+
+static A2DInitState init_state = INIT_NONE;
+static GThread *prewarm_thread = NULL;
+static GMutex init_mutex;
+static GCond init_cond;
+static gint64 load_time = 0;
+static gint first_add_recorded = FALSE;
+
+/* Operations can be run from the plugin and from the worker thread */
+G_LOCK_DEFINE_STATIC (running_operations);
+/* Operations of one batch run in parallel in the pool */
+G_LOCK_DEFINE_STATIC (changed_icon_directories);
+G_LOCK_DEFINE_STATIC (batch_app_ids);
+
+/* Syncs with pending operations, under running_operations */
+static GSList *running_syncs = NULL;
 
 /*
  * NPClass
@@ -74,7 +275,7 @@ static NPClass plugin_ref_obj = {
     np_class_invoke_default,
     np_class_has_property,
     np_class_get_property,
-    NULL,
+    np_class_set_property,
     NULL,
     NULL,
     NULL
@@ -106,7 +307,12 @@ update_modification_date (const char *filename)
 static void
 set_running_executable ()
 {
-    executable = g_environ_getenv (g_get_environ (), "CHROME_WRAPPER");
+    gchar **environment = g_get_environ ();
+
+    executable = g_strdup (g_environ_getenv (environment, "CHROME_WRAPPER"));
+    running_chromium = FALSE;
+
+    g_strfreev (environment);
 
     if (executable) {
         if (strstr (executable, "chromium"))
@@ -120,88 +326,75 @@ set_running_executable ()
 /*
  * get_generated_app_name:
  *
- * Returns .desktop file name of given app.
+ * Returns .desktop file name of given app. The name is interned, the arena
+ * is used only when the cache of names is full.
  */
-static gchar *
-get_generated_app_name (const gchar *app_id)
+static const gchar *
+get_generated_app_name (A2DArena *arena, const gchar *app_id)
 {
-    gchar *app_name;
-    gchar *prefix;
-
-    prefix = app_prefix ? g_strconcat ("-", app_prefix, NULL) : g_strdup ("");
-
-    app_name = g_strconcat ("a2d-", app_id, prefix, NULL);
-
-    g_free (prefix);
-
-    return app_name;
+    return a2d_paths_get_generated_name (paths, app_id, arena);
 }
 
 /*
- * get_desktop_filename:
+ * get_desktop_filename_path:
  *
- * Returns .desktop file name of given app.
+ * Returns .desktop file path of given app.
  */
-static gchar *
-get_desktop_filename (const gchar *app_id)
+static const gchar *
+get_desktop_filename_path (A2DBatch *batch, const gchar *app_id)
 {
-    gchar *desktop_filename;
-    gchar *generated_app_name = get_generated_app_name (app_id);
-
-    desktop_filename = g_strconcat (generated_app_name, ".desktop", NULL);
-
-    g_free (generated_app_name);
-
-    return desktop_filename;
+    return a2d_paths_get_desktop_path (paths, app_id, batch->arena);
 }
 
 /*
- * get_desktop_filename_path:
+ * open_extension_resolver:
  *
- * Returns .desktop file path of given app.
+ * Creates resolver of the Chrom(e|ium) extension directories.
  */
-static gchar *
-get_desktop_filename_path (const gchar *app_id)
+static void
+open_extension_resolver ()
 {
-    gchar *desktop_filename_path;
-    gchar *desktop_filename = get_desktop_filename (app_id);
-
-    desktop_filename_path = g_strconcat (
-        g_get_user_data_dir (), USER_DATA_DIR_APPLICATIONS, desktop_filename, NULL);
-
-    g_free (desktop_filename);
-
-    return desktop_filename_path;
+    extension_resolver = a2d_extension_resolver_new (
+        a2d_paths_get_extensions_directory (paths));
 }
 
 /*
  * get_extension_directory_path:
  *
- * Returns path to Chrom(e|ium) extenstion directory.
+ * Returns path to the directory of the installed version of Chrom(e|ium)
+ * extension.
  */
 static gchar *
-get_extension_directory_path (const gchar *app_id)
+get_extension_directory_path (A2DBatch *batch, const gchar *app_id)
 {
-    GDir *dir;
-    gchar *extension_root;
-    gchar *extension_path = NULL;
+    gchar *path = a2d_extension_resolver_get_path (extension_resolver, app_id);
+    gchar *ret_val = a2d_arena_strdup (batch->arena, path);
+
+    g_free (path);
 
-    extension_root = g_strconcat (
-        g_get_user_config_dir (),
-        running_chromium ? CHROMIUM_EXTENSIONS_PATH : CHROME_EXTENSIONS_PATH,
-        app_id, "/", NULL);
+    return ret_val;
+}
 
-    dir = g_dir_open (extension_root, 0, NULL);
+/*
+ * get_extension_version:
+ *
+ * Returns name of the version directory from the extension directory path.
+ */
+static const gchar *
+get_extension_version (A2DBatch *batch, const gchar *extension_directory)
+{
+    gchar *version;
+    gchar *slash;
 
-    if (dir) {
-        extension_path = g_strconcat (extension_root, g_dir_read_name (dir), "/", NULL);
+    if (!extension_directory)
+        return "";
 
-        g_dir_close (dir);
-    }
+    version = a2d_arena_strdup (batch->arena, extension_directory);
 
-    g_free (extension_root);
+    while ((slash = strrchr (version, '/')) && !slash[1] && slash != version)
+        *slash = '\0';
 
-    return extension_path;
+    return slash ? slash + 1 : version;
 }
 
 /*
@@ -210,46 +403,41 @@ get_extension_directory_path (const gchar *app_id)
  * Returns applications WMClass.
  */
 static gchar *
-get_app_wm_class (const gchar *app_launch_url)
+get_app_wm_class (A2DArena *arena, const gchar *app_launch_url)
 {
         gchar *wm_class, *without_query;
         const gchar *arguments = strstr (app_launch_url, "?");
 
         if (arguments) {
-            without_query = g_strndup (app_launch_url, arguments - app_launch_url - 1);
+            without_query = a2d_arena_strndup (arena, app_launch_url, arguments - app_launch_url - 1);
         } else {
-            without_query = g_strdup (app_launch_url);
+            without_query = a2d_arena_strdup (arena, app_launch_url);
         }
 
         arguments = strstr (without_query, "://");
 
         if (arguments) {
-            wm_class = g_strdup (arguments + 3);
+            wm_class = a2d_arena_strdup (arena, arguments + 3);
         } else {
-            wm_class = g_strdup (without_query);
+            wm_class = a2d_arena_strdup (arena, without_query);
         }
 
-        g_free (without_query);
-
         arguments = strstr (wm_class, "/");
         if (arguments) {
-            gchar *new_wm_class, *beg = g_strndup (wm_class, arguments - wm_class);
+            gchar *new_wm_class, *beg = a2d_arena_strndup (arena, wm_class, arguments - wm_class);
 
             if (g_str_has_suffix (wm_class, "/")) {
                 gint length = strlen (arguments) - 2;
                 length = length >= 0 ? length : 0;
-                gchar *end = g_strndup (arguments + 1, length);
+                gchar *end = a2d_arena_strndup (arena, arguments + 1, length);
                 if (*end)
-                    new_wm_class = g_strconcat (beg, "__", end, NULL);
+                    new_wm_class = a2d_arena_strconcat (arena, beg, "__", end, NULL);
                 else
-                    new_wm_class = g_strdup (beg);
-                g_free (end);
+                    new_wm_class = a2d_arena_strdup (arena, beg);
             } else {
-                new_wm_class = g_strconcat (beg, "__", arguments + 1, NULL);
+                new_wm_class = a2d_arena_strconcat (arena, beg, "__", arguments + 1, NULL);
             }
 
-            g_free (wm_class);
-            g_free (beg);
             wm_class = new_wm_class;
         }
 
@@ -266,604 +454,3282 @@ get_app_wm_class (const gchar *app_launch_url)
         return wm_class;
 }
 
+/*
+ * app_updated:
+ *
+ * Checks whether .desktop file was generated for another version of app.
+ */
 static gboolean
 app_updated (const gchar *desktop_file_filename, const gchar *app_version)
 {
         gchar *content;
-        gboolean ret_val = FALSE;
+        gchar *version_line = g_strconcat ("\nX-App-Version=", app_version, "\n", NULL);
+        gboolean ret_val = TRUE;
 
         if (!g_file_get_contents (desktop_file_filename, &content, NULL, NULL))
             goto out;
 
-        if (strstr (content, "app_version"))
-            ret_val = TRUE;
+        if (strstr (content, version_line))
+            ret_val = FALSE;
 
- out:
         g_free (content);
+ out:
+        g_free (version_line);
 
         return ret_val;
 }
 
 /*
- * check_if_prefix_needed:
+ * open_applications_index:
  *
- * Checks if we need prefix before app name. Prefix is required when we have Chrome
- * and Chromium installed at the same time.
+ * Builds index of the applications directory, it's kept up to date by
+ * inotify.
  */
 static void
-check_if_prefix_needed ()
+open_applications_index ()
 {
-    GDir *dir;
-    gchar *desktop_file_directory;
-    const gchar *desktop_file;
-    gboolean already_found_something = FALSE;
+    applications_index = a2d_dir_index_new (
+        a2d_paths_get_applications_directory (paths));
+}
+
+/*
+ * desktop_file_exists:
+ *
+ * Checks if .desktop file with given path (in the applications directory)
+ * exists.
+ */
+static gboolean
+desktop_file_exists (A2DBatch *batch, const gchar *desktop_file_path)
+{
+    /* Written in this batch, but not committed yet */
+    if (a2d_commit_is_pending (batch->commit, desktop_file_path))
+        return TRUE;
 
-    desktop_file_directory = g_strconcat (
-        g_get_user_data_dir (), USER_DATA_DIR_APPLICATIONS, NULL);
+    return a2d_dir_index_contains (
+        applications_index,
+        a2d_paths_get_desktop_filename (paths, desktop_file_path));
+}
 
-    dir = g_dir_open (desktop_file_directory, 0, NULL);
-    desktop_file = g_dir_read_name (dir);
+/*
+ * hash_stat:
+ *
+ * Adds identity of the file to the hash, missing file hashes as zeros.
+ */
+static guint64
+hash_stat (guint64 hash, const gchar *path)
+{
+    GStatBuf stat_buf;
+    guint64 values[3] = { 0, 0, 0 };
 
-    while (desktop_file) {
-        gchar *content;
-        char *desktop_file_path =
-            g_strconcat (desktop_file_directory, desktop_file, NULL);
+    if (path && !g_stat (path, &stat_buf)) {
+        values[0] = stat_buf.st_ino;
+        values[1] = stat_buf.st_mtime;
+        values[2] = stat_buf.st_size;
+    }
 
-        if (!g_file_get_contents (desktop_file_path, &content, NULL, NULL))
-            goto next;
+    return a2d_hash_data (hash, values, sizeof (values));
+}
 
-        if (strstr (desktop_file, "a2d-"))
-            already_found_something = TRUE;
+/*
+ * is_own_desktop_file:
+ *
+ * Checks if the desktop file was generated by the running browser, by the
+ * index of generated apps.
+ */
+static gboolean
+is_own_desktop_file (const gchar *desktop_file)
+{
+    A2DIndexRecord record;
+    gchar *app_id;
+    gboolean own;
 
-        if (strstr (content, "xdg-open"))
-            goto next;
+    if (!app_index || !g_str_has_prefix (desktop_file, "a2d-"))
+        return FALSE;
 
-        if (running_chromium && strstr (content, executable)) {
-            if (strstr (desktop_file, CHROMIUM))
-                app_prefix = g_strdup (CHROMIUM);
+    app_id = g_strndup (desktop_file + 4, strcspn (desktop_file + 4, "-."));
 
-            goto out;
-        }
+    own = a2d_index_lookup (app_index, app_id, &record) &&
+          g_str_has_prefix (desktop_file, record.generated_name) &&
+          strcmp (desktop_file + strlen (record.generated_name), ".desktop") == 0;
 
-        if (!running_chromium && strstr (content, executable)) {
-            if (strstr (desktop_file, CHROME))
-                app_prefix = g_strdup (CHROME);
+    g_free (app_id);
 
-            goto out;
-        }
+    return own;
+}
 
- next:
-        g_free (content);
-        g_free (desktop_file_path);
-        desktop_file = g_dir_read_name (dir);
+/*
+ * hash_foreign_desktop_files:
+ *
+ * Hashes what the prefix decision depends on: sorted names and identities of
+ * the desktop files not generated by the running browser. Our own writes don't
+ * change it, so the prefix cache survives them.
+ */
+static guint64
+hash_foreign_desktop_files (const gchar *directory, GPtrArray *desktop_files)
+{
+    guint64 hash = A2D_HASH_INIT;
+    guint ii;
 
-        continue;
- out:
-        g_free (content);
-        g_free (desktop_file_path);
-        g_free (desktop_file_directory);
-        g_dir_close(dir);
+    for (ii = 0; ii < desktop_files->len; ii++) {
+        const gchar *desktop_file = g_ptr_array_index (desktop_files, ii);
+        gchar *path;
 
-        return;
+        if (is_own_desktop_file (desktop_file))
+            continue;
+
+        path = g_build_filename (directory, desktop_file, NULL);
+        hash = a2d_hash_string (hash, desktop_file);
+        hash = hash_stat (hash, path);
+        g_free (path);
     }
 
-    if (already_found_something)
-        app_prefix = g_strdup (running_chromium ? CHROMIUM : CHROME);
-    else
-        app_prefix = NULL;
+    return hash;
+}
 
-    g_free (desktop_file_directory);
-    g_dir_close (dir);
+/*
+ * get_prefix_cache_filename:
+ *
+ * Chrome and Chromium have separate prefix caches.
+ */
+static gchar *
+get_prefix_cache_filename ()
+{
+    return g_strconcat (
+        a2d_paths_get_data_directory (paths),
+        running_chromium ? "prefix-chromium" : "prefix-chrome", NULL);
 }
 
 /*
- * enable_app:
+ * load_cached_prefix:
  *
- * Enables / Disables app (hides the .desktop file from app menu) with
- * given id.
+ * Loads prefix decision of previous run. It's valid when executable is the same
+ * and the applications directory wasn't modified, or was modified only by us.
+ * The foreign desktop files are hashed only in the latter case, @hashed tells
+ * if @foreign_hash was set.
  */
 static gboolean
-enable_app (const gchar* app_id, gboolean enable)
+load_cached_prefix (const gchar *directory, time_t directory_mtime, GPtrArray *desktop_files,
+                    guint64 *foreign_hash, gboolean *hashed)
 {
-    GKeyFile *desktop_file = NULL;
+    GKeyFile *key_file = g_key_file_new ();
+    gchar *cache_filename = get_prefix_cache_filename ();
+    gchar *cached_executable = NULL;
+    gchar *cached_hash = NULL;
+    gchar *cached_prefix = NULL;
     gboolean ret_val = FALSE;
-    gchar* desktop_file_filename = get_desktop_filename_path (app_id);
 
-    if (!g_file_test (desktop_file_filename, G_FILE_TEST_EXISTS))
+    if (!g_key_file_load_from_file (key_file, cache_filename, G_KEY_FILE_NONE, NULL))
         goto out;
 
-    desktop_file = g_key_file_new ();
+    cached_executable = g_key_file_get_string (key_file, "Prefix", "Executable", NULL);
+    if (g_strcmp0 (cached_executable, executable) != 0)
+        goto out;
 
-    if (g_key_file_load_from_file (desktop_file,
-                                   desktop_file_filename,
-                                   G_KEY_FILE_KEEP_TRANSLATIONS,
-                                   NULL)) {
+    if (g_key_file_get_int64 (key_file, "Prefix", "DirectoryMtime", NULL) != directory_mtime) {
+        *foreign_hash = hash_foreign_desktop_files (directory, desktop_files);
+        *hashed = TRUE;
 
-        g_key_file_set_boolean (desktop_file,
-                                G_KEY_FILE_DESKTOP_GROUP,
-                                G_KEY_FILE_DESKTOP_KEY_HIDDEN,
-                                !enable);
-    } else
+        cached_hash = g_key_file_get_string (key_file, "Prefix", "ForeignEntries", NULL);
+        if (!cached_hash || g_ascii_strtoull (cached_hash, NULL, 10) != *foreign_hash)
+            goto out;
+    }
+
+    if (!g_key_file_has_key (key_file, "Prefix", "Prefix", NULL))
         goto out;
 
-    g_file_set_contents (desktop_file_filename,
-                         g_key_file_to_data (desktop_file, NULL, NULL),
-                        -1,
-                        NULL);
+    cached_prefix = g_key_file_get_string (key_file, "Prefix", "Prefix", NULL);
+
+    g_free (app_prefix);
+
+    if (g_strcmp0 (cached_prefix, CHROME) == 0 || g_strcmp0 (cached_prefix, CHROMIUM) == 0)
+        app_prefix = g_strdup (cached_prefix);
+    else
+        app_prefix = NULL;
 
     ret_val = TRUE;
+
  out:
-    g_key_file_free (desktop_file);
-    g_free (desktop_file_filename);
+    g_free (cached_prefix);
+    g_free (cached_hash);
+    g_free (cached_executable);
+    g_free (cache_filename);
+    g_key_file_free (key_file);
 
     return ret_val;
 }
 
 /*
- * remove_app_icons:
+ * store_cached_prefix:
  *
- * Removes icons symlinks.
+ * Stores current prefix decision along with the state it was made for.
  */
 static void
-remove_app_icons (const char* app_id)
+store_cached_prefix (time_t directory_mtime, guint64 foreign_hash)
 {
-    GDir *dir;
-    gchar *icon_path_root;
-    const gchar *icon_size_directory_name;
-    gchar *icon_filename;
+    GKeyFile *key_file = g_key_file_new ();
+    gchar *cache_filename = get_prefix_cache_filename ();
+    gchar *hash = g_strdup_printf ("%" G_GUINT64_FORMAT, foreign_hash);
+    gchar *data;
+    gsize length;
 
-    icon_path_root = g_strconcat (
-        g_get_user_data_dir (), USER_DATA_DIR_ICONS, NULL);
+    g_key_file_set_string (key_file, "Prefix", "Executable", executable);
+    g_key_file_set_int64 (key_file, "Prefix", "DirectoryMtime", directory_mtime);
+    g_key_file_set_string (key_file, "Prefix", "ForeignEntries", hash);
+    g_key_file_set_string (key_file, "Prefix", "Prefix", app_prefix ? app_prefix : "");
 
-    dir = g_dir_open (icon_path_root, 0, NULL);
-    icon_size_directory_name = g_dir_read_name (dir);
-
-    while (icon_size_directory_name) {
-        icon_filename = g_strconcat (
-                icon_path_root,
-                icon_size_directory_name, "/apps/",
-                app_id, ".png", NULL);
+    data = g_key_file_to_data (key_file, &length, NULL);
+    if (data) {
+        gchar *cache_directory = g_path_get_dirname (cache_filename);
 
-        g_remove (icon_filename);
+        g_mkdir_with_parents (cache_directory, 0700);
+        g_file_set_contents (cache_filename, data, length, NULL);
 
-        icon_size_directory_name = g_dir_read_name (dir);
-        g_free (icon_filename);
+        g_free (cache_directory);
     }
 
-    g_free (icon_path_root);
-    g_dir_close (dir);
+    g_free (data);
+    g_free (hash);
+    g_free (cache_filename);
+    g_key_file_free (key_file);
 }
 
 /*
- * remove_app:
+ * check_if_prefix_needed:
  *
- * Removes app .desktop file.
+ * Checks if we need prefix before app name. Prefix is required when we have Chrome
+ * and Chromium installed at the same time.
+ *
+ * Only the Exec keys of the desktop files are scanned and the decision is cached
+ * between runs. Desktop files are hashed only when the applications directory
+ * was modified since, so in the common case none of them is even stat'ed. A file
+ * rewritten in place doesn't modify the directory, so it's not noticed.
  */
-static gboolean
-remove_app (const char* app_id)
+static void
+check_if_prefix_needed ()
 {
-    GDir *dir;
-    gchar *desktop_file_directory;
-    gchar *desktop_file_path;
-    const gchar *desktop_file;
-    gchar* desktop_file_filename = get_desktop_filename (app_id);
+    GPtrArray *desktop_files;
+    A2DDesktopScanResult *results;
+    const gchar *desktop_file_directory = a2d_paths_get_applications_directory (paths);
+    GStatBuf stat_buf;
+    time_t directory_mtime = 0;
+    guint64 foreign_hash = 0;
+    gboolean already_found_something = FALSE;
+    gboolean hashed = FALSE;
+    guint ii;
+
+    /* Left from the initialization before shutdown */
+    g_free (app_prefix);
+    app_prefix = NULL;
+
+    if (!g_stat (desktop_file_directory, &stat_buf))
+        directory_mtime = stat_buf.st_mtime;
 
-    desktop_file_directory = g_strconcat (
-        g_get_user_data_dir (), USER_DATA_DIR_APPLICATIONS, NULL);
+    desktop_files = a2d_dir_index_get_names (applications_index);
 
-    dir = g_dir_open (desktop_file_directory, 0, NULL);
-    desktop_file = g_dir_read_name (dir);
+    if (load_cached_prefix (desktop_file_directory, directory_mtime, desktop_files,
+                            &foreign_hash, &hashed)) {
+        /* Modified only by us, the decision holds for the new mtime */
+        if (hashed)
+            store_cached_prefix (directory_mtime, foreign_hash);
 
-    while (desktop_file) {
-        if (g_strcmp0 (desktop_file, desktop_file_filename) != 0) {
-            desktop_file = g_dir_read_name (dir);
+        goto out;
+    }
+
+    results = a2d_desktop_scan_files (desktop_file_directory, desktop_files, executable);
+
+    /* Names are sorted, so the first match doesn't depend on the scan order */
+    for (ii = 0; ii < desktop_files->len; ii++) {
+        const gchar *desktop_file = g_ptr_array_index (desktop_files, ii);
 
+        if (results[ii] == A2D_DESKTOP_SCAN_UNREADABLE)
             continue;
-        }
 
-        desktop_file_path = g_strconcat (
-                desktop_file_directory,
-                desktop_file, NULL);
+        if (strstr (desktop_file, "a2d-"))
+            already_found_something = TRUE;
 
-        if (!g_remove (desktop_file_path)) {
-            gchar *generated_app_name = get_generated_app_name (app_id);
-            remove_app_icons (generated_app_name);
-            g_free (desktop_file_path);
-            g_free (generated_app_name);
-            break;
-        }
+        if (results[ii] != A2D_DESKTOP_SCAN_EXECUTABLE)
+            continue;
+
+        if (running_chromium && strstr (desktop_file, CHROMIUM))
+            app_prefix = g_strdup (CHROMIUM);
+
+        if (!running_chromium && strstr (desktop_file, CHROME))
+            app_prefix = g_strdup (CHROME);
 
-        g_free (desktop_file_path);
+        break;
     }
 
-    g_free (desktop_file_directory);
-    g_free (desktop_file_filename);
-    g_dir_close (dir);
+    if (ii == desktop_files->len) {
+        if (already_found_something)
+            app_prefix = g_strdup (running_chromium ? CHROMIUM : CHROME);
+        else
+            app_prefix = NULL;
+    }
 
-    return FALSE;
+    g_free (results);
+
+    if (!hashed)
+        foreign_hash = hash_foreign_desktop_files (desktop_file_directory, desktop_files);
+
+    store_cached_prefix (directory_mtime, foreign_hash);
+
+ out:
+    a2d_paths_set_app_prefix (paths, app_prefix);
+    g_ptr_array_free (desktop_files, TRUE);
 }
 
 /*
- * save_localizations:
+ * open_app_index:
  *
- * Parses and saves localization data from app to .desktop file.
+ * Opens index of generated apps. Chrome and Chromium have separate indexes.
  */
 static void
-save_localizations (GKeyFile *desktop_file, const gchar *app_id)
+open_app_index ()
 {
-    GDir *dir;
-    JsonParser *parser;
-    JsonReader *reader;
-    GError *error = NULL;
-    gchar *localization_directory;
-    const gchar *locale;
-    gchar *extension_directory = get_extension_directory_path(app_id);
-
-    localization_directory = g_strconcat (extension_directory, "_locales/", NULL);
-
-    parser = json_parser_new ();
-
-    dir = g_dir_open (localization_directory, 0, NULL);
-    locale = g_dir_read_name (dir);
+    gchar *index_filename = g_strconcat (
+        a2d_paths_get_data_directory (paths),
+        running_chromium ? "index-chromium" : "index-chrome", NULL);
 
-    while (locale) {
-        gchar *json_locale_file =
-            g_strconcat (localization_directory, locale, "/messages.json", NULL);
+    app_index = a2d_index_open (index_filename);
 
-        json_parser_load_from_file (parser, json_locale_file, &error);
+    g_free (index_filename);
+}
 
-        g_free (json_locale_file);
+/*
+ * adopt_generated_apps:
+ *
+ * Records apps generated before the index existed, so they can be removed
+ * by sync. What was generated for them isn't known, so they don't have the
+ * extension version and they are regenerated on next add.
+ */
+static void
+adopt_generated_apps ()
+{
+    GPtrArray *desktop_files = a2d_dir_index_get_names (applications_index);
+    A2DArena *arena = a2d_arena_new (ARENA_BLOCK_SIZE);
+    guint ii;
+
+    for (ii = 0; ii < desktop_files->len; ii++) {
+        const gchar *desktop_file = g_ptr_array_index (desktop_files, ii);
+        A2DIndexRecord record;
+        gchar *generated_name, *app_id;
+        const gchar *expected_name;
+
+        if (!g_str_has_prefix (desktop_file, "a2d-") ||
+            !g_str_has_suffix (desktop_file, ".desktop"))
+            continue;
 
-        if (error) {
-            g_error_free (error);
-            locale = g_dir_read_name (dir);
+        a2d_arena_reset (arena);
 
-            continue;
-        }
+        generated_name = a2d_arena_strndup (
+            arena, desktop_file, strlen (desktop_file) - strlen (".desktop"));
+        app_id = a2d_arena_strndup (
+            arena, generated_name + 4, strcspn (generated_name + 4, "-"));
+        expected_name = get_generated_app_name (arena, app_id);
 
-        reader = json_reader_new (json_parser_get_root (parser));
-
-        if (json_reader_read_member (reader, "appName")) {
-            json_reader_read_member (reader, "message");
-            g_key_file_set_locale_string (desktop_file,
-                                          G_KEY_FILE_DESKTOP_GROUP,
-                                          G_KEY_FILE_DESKTOP_KEY_NAME,
-                                          locale,
-                                          json_reader_get_string_value (reader));
-            json_reader_end_element (reader);
-            json_reader_end_element (reader);
-        }
+        /* Only apps generated by the running browser */
+        if (g_strcmp0 (generated_name, expected_name) == 0) {
+            memset (&record, 0, sizeof (A2DIndexRecord));
+            g_strlcpy (record.app_id, app_id, sizeof (record.app_id));
+            g_strlcpy (record.generated_name, generated_name, sizeof (record.generated_name));
+            record.enabled = TRUE;
 
-        if (json_reader_read_member (reader, "appDesc")) {
-            json_reader_read_member (reader, "message");
-            g_key_file_set_locale_string (desktop_file,
-                                          G_KEY_FILE_DESKTOP_GROUP,
-                                          G_KEY_FILE_DESKTOP_KEY_COMMENT,
-                                          locale,
-                                          json_reader_get_string_value (reader));
+            a2d_index_store (app_index, &record);
         }
-        locale = g_dir_read_name (dir);
     }
 
-    g_dir_close (dir);
-    g_object_unref (parser);
-    g_object_unref (reader);
-    g_free (localization_directory);
-    g_free (extension_directory);
+    a2d_arena_free (arena);
+    g_ptr_array_free (desktop_files, TRUE);
 }
 
 /*
- * add_app:
+ * initialize:
  *
- * Parses app informations, creates .desktop file and symlinks app icons.
+ * Finds out the running browser, decides on the prefix of generated apps and
+ * opens the indexes.
  */
-static gboolean
-add_app (const gchar* app_name, const gchar* app_id, const char* app_version,
-         const gchar* app_launch_url, gboolean app_enabled)
-{
-    JsonParser *parser;
-    JsonReader *reader;
-    GError *error = NULL;
-    GKeyFile *desktop_file;
-    gboolean offline_enabled = FALSE;
-    gboolean ret_val = TRUE;
-    gchar *icon_directory, *launch_sequence, *desktop_name, *wm_class, *tmp_prefix;
-    gchar *extension_directory = get_extension_directory_path (app_id);
-    gchar *desktop_file_filename = get_desktop_filename_path (app_id);
-    gchar *generated_app_name = get_generated_app_name (app_id);
-    gchar *manifest_file_path = g_strconcat (extension_directory, MANIFEST_FILE, NULL);
-
-    if (g_file_test (desktop_file_filename, G_FILE_TEST_EXISTS)) {
-        if (!app_updated (desktop_file_filename, app_version))
-            goto out;
-        else
-            remove_app (app_id);
-    }
+static void
+initialize ()
+{
+    gint64 start = a2d_stats_get_time_ns ();
 
-    parser = json_parser_new ();
+    set_running_executable ();
+    paths = a2d_paths_new (running_chromium);
+    open_applications_index ();
+    open_extension_resolver ();
+    /* The prefix check tells our desktop files by the index */
+    open_app_index ();
+    check_if_prefix_needed ();
 
-    json_parser_load_from_file (parser, manifest_file_path, &error);
-    if (error) {
-        g_error_free (error);
-        g_object_unref (parser);
+    if (app_index && a2d_index_was_created (app_index))
+        adopt_generated_apps ();
 
-        ret_val = FALSE;
-        goto out;
-    }
+    a2d_stats_add (A2D_STAT_INIT_NSEC, a2d_stats_get_time_ns () - start);
+}
 
-    g_free (manifest_file_path);
+/*
+ * prewarm_thread_func:
+ */
+static gpointer
+prewarm_thread_func (gpointer data)
+{
+    initialize ();
 
-    reader = json_reader_new (json_parser_get_root (parser));
-    desktop_file = g_key_file_new ();
+    g_mutex_lock (&init_mutex);
+    init_state = INIT_DONE;
+    g_cond_broadcast (&init_cond);
+    g_mutex_unlock (&init_mutex);
 
-    g_key_file_set_value (desktop_file,
-                          G_KEY_FILE_DESKTOP_GROUP,
-                          G_KEY_FILE_DESKTOP_KEY_TYPE,
-                          G_KEY_FILE_DESKTOP_TYPE_APPLICATION);
+    return NULL;
+}
 
-    tmp_prefix = app_prefix ? g_strconcat (app_prefix, " - ", NULL) : g_strdup ("");
-    desktop_name = g_strconcat (tmp_prefix, app_name, NULL);
-    g_free (tmp_prefix);
+/*
+ * ensure_initialized:
+ *
+ * Waits for the prewarm to finish if it's still running, or initializes the
+ * shared state here when there was no prewarm.
+ */
+static void
+ensure_initialized ()
+{
+    gint64 wait_start;
 
-    g_key_file_set_value (desktop_file,
-                          G_KEY_FILE_DESKTOP_GROUP,
-                          G_KEY_FILE_DESKTOP_KEY_NAME,
-                          desktop_name);
+    g_mutex_lock (&init_mutex);
 
-    if (*app_launch_url)
-        launch_sequence = g_strconcat (executable, " --app=", app_launch_url, NULL);
-    else
-        launch_sequence = g_strconcat (executable, " --app-id=", app_id, NULL);
+    if (init_state == INIT_DONE) {
+        g_mutex_unlock (&init_mutex);
+        return;
+    }
 
-    g_key_file_set_value (desktop_file,
-                          G_KEY_FILE_DESKTOP_GROUP,
-                          G_KEY_FILE_DESKTOP_KEY_EXEC,
-                          launch_sequence);
+    if (init_state == INIT_NONE) {
+        init_state = INIT_RUNNING;
+        g_mutex_unlock (&init_mutex);
 
-    g_free (launch_sequence);
+        initialize ();
 
-    if (*app_launch_url) {
-        wm_class = get_app_wm_class (app_launch_url);
-    } else
-        wm_class = g_strconcat ("crx_", app_id, NULL);
-
-    g_key_file_set_value (desktop_file,
-                          G_KEY_FILE_DESKTOP_GROUP,
-                          G_KEY_FILE_DESKTOP_KEY_STARTUP_WM_CLASS,
-                          wm_class);
-    g_free (wm_class);
-
-    g_key_file_set_value (desktop_file,
-                          G_KEY_FILE_DESKTOP_GROUP,
-                          G_KEY_FILE_DESKTOP_KEY_CATEGORIES,
-                          "NETWORK");
-    g_key_file_set_value (desktop_file,
-                          G_KEY_FILE_DESKTOP_GROUP,
-                          G_KEY_FILE_DESKTOP_KEY_ICON,
-                          generated_app_name);
-    g_key_file_set_boolean (desktop_file,
-                            G_KEY_FILE_DESKTOP_GROUP,
-                            G_KEY_FILE_DESKTOP_KEY_TERMINAL,
-                            FALSE);
-
-    if (json_reader_read_member (reader, "offline_enabled"))
-        offline_enabled = json_reader_get_boolean_value (reader);
-
-    json_reader_end_element (reader);
-    g_key_file_set_boolean (desktop_file,
-                            G_KEY_FILE_DESKTOP_GROUP,
-                            "X-Offline-Enabled",
-                            offline_enabled);
-    g_key_file_set_boolean (desktop_file,
-                            G_KEY_FILE_DESKTOP_GROUP,
-                            G_KEY_FILE_DESKTOP_KEY_HIDDEN,
-                            !app_enabled);
-    g_key_file_set_value (desktop_file,
-                          G_KEY_FILE_DESKTOP_GROUP,
-                          "X-App-Version",
-                          app_version);
-
-//    save_localizations (desktop_file, app_id);
-
-    g_file_set_contents (
-            desktop_file_filename,
-            g_key_file_to_data (desktop_file, NULL, NULL),
-            -1,
-            NULL);
-
-    g_key_file_free (desktop_file);
-
-    icon_directory = g_strconcat (
-        g_get_user_data_dir (), USER_DATA_DIR_ICONS, NULL);
-
-    if (json_reader_read_member (reader, "icons")) {
-        gint ii;
-        for (ii = 0; ii < json_reader_count_members (reader); ii++) {
-            json_reader_read_element (reader, ii);
-
-            const char *icon_size = json_reader_get_member_name (reader);
-            const char *icon_filename = json_reader_get_string_value (reader);
-
-            gchar *dest_icon_path =
-                g_strconcat (icon_directory, icon_size, "x", icon_size, "/apps/", NULL);
-
-            gchar *dest_icon_path_icon =
-                g_strconcat (dest_icon_path, generated_app_name, ".png", NULL);
-
-            gchar *src_icon_path =
-                g_strconcat (extension_directory, icon_filename, NULL);
-
-            g_mkdir_with_parents (dest_icon_path, 0775);
-            symlink (src_icon_path, dest_icon_path_icon);
-
-            g_free (dest_icon_path);
-            g_free (dest_icon_path_icon);
-            g_free (src_icon_path);
-        }
+        g_mutex_lock (&init_mutex);
+        init_state = INIT_DONE;
+        g_cond_broadcast (&init_cond);
+        g_mutex_unlock (&init_mutex);
+        return;
     }
 
-    /* When icons are installed we need to update modification time of
-     * icon's parent directory to get the icon's cache be rebuilded */
-    update_modification_date (icon_directory);
+    wait_start = a2d_stats_get_time_ns ();
 
-    g_object_unref (reader);
-    g_object_unref (parser);
-    g_free (icon_directory);
-    g_free (desktop_name);
+    while (init_state != INIT_DONE)
+        g_cond_wait (&init_cond, &init_mutex);
 
- out:
-    g_free (generated_app_name);
-    g_free (extension_directory);
-    g_free (desktop_file_filename);
+    g_mutex_unlock (&init_mutex);
 
-    return ret_val;
+    a2d_stats_add (A2D_STAT_INIT_WAITS, 1);
+    a2d_stats_add (A2D_STAT_INIT_WAIT_NSEC, a2d_stats_get_time_ns () - wait_start);
 }
 
 /*
- * a2d_plugin_set_no_netscape_functions:
+ * record_first_add:
  *
+ * Records the time from the plugin load to the first added app.
  */
-void
-a2d_plugin_set_np_netscape_functions (NPNetscapeFuncs *npnfunctions)
+static void
+record_first_add ()
 {
-    npnfuncs = npnfunctions;
+    if (g_atomic_int_compare_and_exchange (&first_add_recorded, FALSE, TRUE))
+        a2d_stats_add (A2D_STAT_FIRST_ADD_NSEC, a2d_stats_get_time_ns () - load_time);
 }
 
-NPObject*
-np_class_allocate(NPP instance, NPClass* npclass)
+/*
+ * get_indexed_desktop_filename_path:
+ *
+ * Returns .desktop file path of app from the index.
+ */
+static const gchar *
+get_indexed_desktop_filename_path (A2DBatch *batch, const A2DIndexRecord *record)
 {
-    return g_new0 (NPObject, 1);
+    return a2d_arena_strconcat (
+        batch->arena, batch->applications_directory, record->generated_name, ".desktop", NULL);
 }
 
-void
-np_class_deallocate(NPObject* obj)
+/*
+ * write_desktop_data:
+ *
+ * Saves contents of .desktop file as part of the batch's commit. Desktop
+ * environments reload their menus whenever a .desktop file is written, so
+ * when the file already has the same contents it's left alone.
+ */
+static gboolean
+write_desktop_data (A2DBatch *batch, const gchar *desktop_file_path,
+                    const gchar *data, gsize length)
 {
-    g_free (obj);
-}
+    gchar *old_data;
+    gsize old_length;
+    gboolean unchanged = FALSE;
 
-bool
-np_class_has_method(NPObject* obj, NPIdentifier method_name)
-{
-    NPIdentifier add_id = npnfuncs->getstringidentifier(METHOD_ADD);
-    NPIdentifier remove_id = npnfuncs->getstringidentifier(METHOD_REMOVE);
-    NPIdentifier enable_id = npnfuncs->getstringidentifier(METHOD_ENABLE);
-    NPIdentifier disable_id = npnfuncs->getstringidentifier(METHOD_DISABLE);
+    if (a2d_commit_read (batch->commit, desktop_file_path, &old_data, &old_length)) {
+        unchanged = old_length == length && !memcmp (old_data, data, length);
+        g_free (old_data);
+    }
 
-    return (method_name == add_id || method_name == remove_id ||
-            method_name == enable_id || method_name == disable_id);
-}
+    if (unchanged) {
+        a2d_stats_add (A2D_STAT_DESKTOP_WRITES_SKIPPED, 1);
+        return TRUE;
+    }
 
-bool
-np_class_invoke_default(NPObject* obj, const NPVariant* args,
-                            uint32_t argCount, NPVariant* result)
-{
-    return true;
+    a2d_stats_add (A2D_STAT_DESKTOP_WRITES, 1);
+
+    return a2d_commit_write (batch->commit, desktop_file_path, data, length);
 }
 
-bool
-np_class_invoke(NPObject* obj, NPIdentifier method_name, const NPVariant* args,
-                uint32_t arg_count, NPVariant* result)
+/*
+ * write_desktop_file:
+ *
+ * Saves .desktop file as part of the batch's commit.
+ */
+static gboolean
+write_desktop_file (A2DBatch *batch, const gchar *desktop_file_path, GKeyFile *desktop_file)
 {
-    NPIdentifier add_id = npnfuncs->getstringidentifier(METHOD_ADD);
-    NPIdentifier remove_id = npnfuncs->getstringidentifier(METHOD_REMOVE);
-    NPIdentifier enable_id = npnfuncs->getstringidentifier(METHOD_ENABLE);
-    NPIdentifier disable_id = npnfuncs->getstringidentifier(METHOD_DISABLE);
+    gsize length;
+    gchar *data = g_key_file_to_data (desktop_file, &length, NULL);
+    gboolean ret_val;
 
-    if (!executable) {
-        set_running_executable ();
-        check_if_prefix_needed ();
-    }
+    ret_val = write_desktop_data (batch, desktop_file_path, data, length);
 
-    if (method_name == add_id) {
-        gboolean ret_val = FALSE;
-        gchar *app_name, *app_id, *app_version, *app_launch_url;
+    g_free (data);
 
-        /* 5 arguments */
-        /* 1 - app name */
-        /* 2 - app id */
-        /* 3 - app version */
-        /* 4 - launch url */
-        /* 5 - enabled ? */
-        if (arg_count != 5)
-            return false;
+    return ret_val;
+}
 
-        if (!(NPVARIANT_IS_STRING (args[0]) && NPVARIANT_IS_STRING (args[1]) && NPVARIANT_IS_STRING (args[2]) &&
-                    NPVARIANT_IS_STRING (args[3]) && NPVARIANT_IS_BOOLEAN (args[4])))
+/*
+ * enable_app:
+ *
+ * Enables / Disables app (hides the .desktop file from app menu) with
+ * given id.
+ */
+static gboolean
+enable_app (A2DBatch *batch, const gchar* app_id, gboolean enable)
+{
+    GKeyFile *desktop_file = NULL;
+    A2DIndexRecord record;
+    gchar *contents = NULL;
+    gchar *patched = NULL;
+    gsize length, patched_length;
+    gboolean ret_val = FALSE;
+    gboolean indexed = app_index && a2d_index_lookup (app_index, app_id, &record);
+    const gchar* desktop_file_filename = indexed ?
+        get_indexed_desktop_filename_path (batch, &record) :
+        get_desktop_filename_path (batch, app_id);
+
+    if (!desktop_file_exists (batch, desktop_file_filename))
+        goto out;
+
+    if (!a2d_commit_read (batch->commit, desktop_file_filename, &contents, &length))
+        goto out;
+
+    switch (a2d_desktop_entry_patch_hidden (contents, length, !enable,
+                                            &patched, &patched_length)) {
+    case A2D_DESKTOP_ENTRY_PATCH_UNCHANGED:
+        a2d_stats_add (A2D_STAT_ENABLE_UNCHANGED, 1);
+        break;
+    case A2D_DESKTOP_ENTRY_PATCH_CHANGED:
+        a2d_stats_add (A2D_STAT_ENABLE_PATCHED, 1);
+        if (!write_desktop_data (batch, desktop_file_filename, patched, patched_length))
+            goto out;
+        break;
+    default:
+        /* No [Desktop Entry] group to patch, let GKeyFile create it */
+        desktop_file = g_key_file_new ();
+
+        if (!g_key_file_load_from_data (desktop_file,
+                                        contents,
+                                        length,
+                                        G_KEY_FILE_KEEP_TRANSLATIONS,
+                                        NULL))
+            goto out;
+
+        g_key_file_set_boolean (desktop_file,
+                                G_KEY_FILE_DESKTOP_GROUP,
+                                G_KEY_FILE_DESKTOP_KEY_HIDDEN,
+                                !enable);
+
+        if (!write_desktop_file (batch, desktop_file_filename, desktop_file))
+            goto out;
+    }
+
+    if (indexed && record.enabled != enable) {
+        record.enabled = enable;
+        a2d_index_store (app_index, &record);
+    }
+
+    ret_val = TRUE;
+ out:
+    if (desktop_file)
+        g_key_file_free (desktop_file);
+    g_free (patched);
+    g_free (contents);
+
+    return ret_val;
+}
+
+/*
+ * mark_icon_directory_changed:
+ *
+ * Remembers size directory (e.g. "48x48") of the icon theme, which has to be
+ * touched at the end of the batch.
+ */
+static void
+mark_icon_directory_changed (A2DBatch *batch, const gchar *size_directory)
+{
+    G_LOCK (changed_icon_directories);
+
+    if (!g_hash_table_contains (batch->changed_icon_directories, size_directory))
+        g_hash_table_add (batch->changed_icon_directories, g_strdup (size_directory));
+
+    G_UNLOCK (changed_icon_directories);
+}
+
+/*
+ * remove_app_icons:
+ *
+ * Removes icons symlinks.
+ */
+static void
+remove_app_icons (A2DBatch *batch, const char* app_id)
+{
+    GDir *dir;
+    const gchar *icon_path_root = batch->icon_directory;
+    const gchar *icon_size_directory_name;
+    gchar *icon_filename;
+
+    dir = g_dir_open (icon_path_root, 0, NULL);
+    if (!dir)
+        return;
+
+    icon_size_directory_name = g_dir_read_name (dir);
+
+    while (icon_size_directory_name) {
+        icon_filename = a2d_arena_strconcat (
+                batch->arena,
+                icon_path_root,
+                icon_size_directory_name, "/apps/",
+                app_id, ".png", NULL);
+
+        if (!g_remove (icon_filename))
+            mark_icon_directory_changed (batch, icon_size_directory_name);
+
+        icon_size_directory_name = g_dir_read_name (dir);
+    }
+
+    g_dir_close (dir);
+}
+
+/*
+ * remove_indexed_app_icons:
+ *
+ * Removes icons of app from the index, generated icons marked in keep are
+ * left in place.
+ */
+static void
+remove_indexed_app_icons (A2DBatch *batch, const A2DIndexRecord *record, guint16 keep)
+{
+    guint ii;
+
+    for (ii = 0; ii < record->n_icon_sizes; ii++) {
+        gchar *size_directory;
+        gchar *icon_filename;
+
+        if (keep & (1 << ii))
+            continue;
+
+        size_directory = a2d_arena_printf (
+            batch->arena, "%ux%u", record->icon_sizes[ii], record->icon_sizes[ii]);
+        icon_filename = a2d_arena_strconcat (
+            batch->arena, batch->icon_directory, size_directory, "/apps/",
+            record->generated_name, ".png", NULL);
+
+        if (a2d_commit_remove (batch->commit, icon_filename))
+            mark_icon_directory_changed (batch, size_directory);
+    }
+}
+
+/*
+ * remove_indexed_app:
+ *
+ * Removes .desktop file and icons of app from the index. The .desktop
+ * file is kept when it's going to be rewritten under the same name.
+ */
+static void
+remove_indexed_app (A2DBatch *batch, const A2DIndexRecord *record,
+                    guint16 keep_icons, gboolean keep_desktop_file)
+{
+    const gchar *desktop_file_path = get_indexed_desktop_filename_path (batch, record);
+
+    if (!keep_desktop_file)
+        a2d_commit_remove (batch->commit, desktop_file_path);
+
+    /* Icons of adopted apps are unknown */
+    if (*record->extension_version)
+        remove_indexed_app_icons (batch, record, keep_icons);
+    else
+        remove_app_icons (batch, record->generated_name);
+
+    a2d_index_remove (app_index, record->app_id);
+}
+
+/*
+ * remove_app:
+ *
+ * Removes app .desktop file.
+ */
+static gboolean
+remove_app (A2DBatch *batch, const char* app_id)
+{
+    A2DIndexRecord record;
+    const gchar *desktop_file_path;
+    gboolean ret_val = FALSE;
+
+    if (app_index && a2d_index_lookup (app_index, app_id, &record)) {
+        remove_indexed_app (batch, &record, 0, FALSE);
+
+        return TRUE;
+    }
+
+    /* App was generated before the index existed */
+    desktop_file_path = get_desktop_filename_path (batch, app_id);
+
+    if (a2d_commit_remove (batch->commit, desktop_file_path)) {
+        remove_app_icons (batch, get_generated_app_name (batch->arena, app_id));
+        ret_val = TRUE;
+    }
+
+    return ret_val;
+}
+
+/*
+ * get_localizations:
+ *
+ * Returns localized names and comments of app. The manifest references its
+ * messages by __MSG_name__ placeholders, apps without them are looked up
+ * under the names Chrome Web Store suggests.
+ */
+static GPtrArray *
+get_localizations (A2DBatch *batch, const gchar *extension_directory, A2DManifest *manifest)
+{
+    GPtrArray *localizations;
+    gchar *locales_directory = a2d_arena_strconcat (
+        batch->arena, extension_directory, LOCALES_DIRECTORY, NULL);
+    gchar *name_key = a2d_locale_get_message_key (manifest->name);
+    gchar *comment_key = a2d_locale_get_message_key (manifest->description);
+
+    localizations = a2d_locale_catalog_get (
+        locale_catalog, locales_directory,
+        name_key ? name_key : "appName",
+        comment_key ? comment_key : "appDesc",
+        g_atomic_int_get (&system_locales_only) ? g_get_language_names () : NULL);
+
+    g_free (name_key);
+    g_free (comment_key);
+
+    return localizations;
+}
+
+/*
+ * get_icon_sources:
+ *
+ * Reads real sizes of the manifest's icons from their PNG headers and
+ * computes fingerprint of their sizes and stats, the icons aren't read. Icons,
+ * which aren't PNG images, are trusted to have the size from the manifest.
+ */
+static GPtrArray *
+get_icon_sources (A2DBatch *batch, const gchar *extension_directory, A2DManifest *manifest,
+                  guint64 *fingerprint)
+{
+    GPtrArray *sources = g_ptr_array_new ();
+    guint ii;
+
+    *fingerprint = A2D_HASH_INIT;
+
+    for (ii = 0; ii < manifest->icons->len; ii++) {
+        A2DManifestIcon *icon = g_ptr_array_index (manifest->icons, ii);
+        A2DIconSource *source = a2d_arena_alloc (batch->arena, sizeof (A2DIconSource));
+        guint width, height;
+
+        source->path = a2d_arena_strconcat (batch->arena, extension_directory, icon->filename, NULL);
+        source->size = 0;
+
+        if (a2d_icon_read_png_size (source->path, &width, &height)) {
+            if (width == height)
+                source->size = width;
+        } else {
+            source->size = g_ascii_strtoull (icon->size, NULL, 10);
+        }
+
+        if (!source->size || source->size > G_MAXUINT16) {
+            a2d_stats_add (A2D_STAT_ICONS_REJECTED, 1);
+            continue;
+        }
+
+        *fingerprint = a2d_hash_data (*fingerprint, &source->size, sizeof (source->size));
+        *fingerprint = hash_stat (*fingerprint, source->path);
+
+        g_ptr_array_add (sources, source);
+    }
+
+    return sources;
+}
+
+/*
+ * record_icon:
+ *
+ * Adds icon size to the record, returns FALSE when it's already there.
+ */
+static gboolean
+record_icon (A2DIndexRecord *record, guint size, gboolean generated)
+{
+    guint ii;
+
+    for (ii = 0; ii < record->n_icon_sizes; ii++) {
+        if (record->icon_sizes[ii] == size)
+            return FALSE;
+    }
+
+    if (record->n_icon_sizes == A2D_INDEX_MAX_ICONS)
+        return FALSE;
+
+    if (generated)
+        record->generated_icons |= 1 << record->n_icon_sizes;
+
+    record->icon_sizes[record->n_icon_sizes++] = size;
+
+    return TRUE;
+}
+
+/*
+ * find_scaling_source:
+ *
+ * Returns the smallest icon not smaller than size, or the largest icon.
+ */
+static A2DIconSource *
+find_scaling_source (GPtrArray *sources, guint size)
+{
+    A2DIconSource *best = NULL;
+    guint ii;
+
+    for (ii = 0; ii < sources->len; ii++) {
+        A2DIconSource *source = g_ptr_array_index (sources, ii);
+
+        if (!best ||
+            (source->size >= size && (best->size < size || source->size < best->size)) ||
+            (source->size < size && best->size < source->size))
+            best = source;
+    }
+
+    return best;
+}
+
+/*
+ * install_app_icons:
+ *
+ * Symlinks icons of standard sizes to the theme and generates the missing
+ * standard sizes by scaling. Sizes larger than the largest source aren't
+ * generated, blurry upscaled icon would win the theme lookup. Icons generated
+ * from the same sources before are marked in kept_icons and reused.
+ */
+static void
+install_app_icons (A2DBatch *batch, GPtrArray *sources, const A2DIndexRecord *old_record,
+                   guint16 kept_icons, A2DIndexRecord *record)
+{
+    const guint *standard_sizes;
+    guint n_standard_sizes;
+    guint max_size = 0;
+    guint ii;
+
+    for (ii = 0; ii < sources->len; ii++) {
+        A2DIconSource *source = g_ptr_array_index (sources, ii);
+        gchar *size_directory, *dest_icon_path, *dest_icon_path_icon;
+
+        max_size = MAX (max_size, source->size);
+
+        /* Odd sizes are used only for scaling */
+        if (!a2d_icon_is_standard_size (source->size) || !record_icon (record, source->size, FALSE))
+            continue;
+
+        size_directory = a2d_arena_printf (batch->arena, "%ux%u", source->size, source->size);
+        dest_icon_path = a2d_arena_strconcat (
+            batch->arena, batch->icon_directory, size_directory, "/apps/", NULL);
+        dest_icon_path_icon = a2d_arena_strconcat (
+            batch->arena, dest_icon_path, record->generated_name, ".png", NULL);
+
+        g_mkdir_with_parents (dest_icon_path, 0775);
+        if (a2d_commit_symlink (batch->commit, source->path, dest_icon_path_icon))
+            mark_icon_directory_changed (batch, size_directory);
+    }
+
+    for (ii = 0; ii < old_record->n_icon_sizes; ii++) {
+        if (kept_icons & (1 << ii) && record_icon (record, old_record->icon_sizes[ii], TRUE))
+            a2d_stats_add (A2D_STAT_ICONS_REUSED, 1);
+    }
+
+    if (!sources->len)
+        return;
+
+    standard_sizes = a2d_icon_get_standard_sizes (&n_standard_sizes);
+
+    for (ii = 0; ii < n_standard_sizes; ii++) {
+        guint size = standard_sizes[ii];
+        A2DIconSource *source;
+        gchar *size_directory, *dest_icon_path, *dest_icon_path_icon;
+        gchar *data;
+        gsize length;
+
+        if (size > max_size || !record_icon (record, size, TRUE))
+            continue;
+
+        source = find_scaling_source (sources, size);
+        data = a2d_icon_scale (source->path, size, &length);
+        if (!data) {
+            /* Drops the size recorded above */
+            record->generated_icons &= ~(1 << --record->n_icon_sizes);
+            continue;
+        }
+
+        size_directory = a2d_arena_printf (batch->arena, "%ux%u", size, size);
+        dest_icon_path = a2d_arena_strconcat (
+            batch->arena, batch->icon_directory, size_directory, "/apps/", NULL);
+        dest_icon_path_icon = a2d_arena_strconcat (
+            batch->arena, dest_icon_path, record->generated_name, ".png", NULL);
+
+        g_mkdir_with_parents (dest_icon_path, 0775);
+        if (a2d_commit_write (batch->commit, dest_icon_path_icon, data, length))
+            mark_icon_directory_changed (batch, size_directory);
+
+        a2d_stats_add (A2D_STAT_ICONS_GENERATED, 1);
+
+        g_free (data);
+    }
+}
+
+/*
+ * get_input_fingerprint:
+ *
+ * Hashes everything the generated .desktop file and icons depend on. App
+ * icons are listed only in the manifest, but Chrome never changes version
+ * directory of an installed extension, new version is unpacked into a new
+ * one, so the manifest and the directory stand in for them and for the
+ * localizations. Enabled state
+ * is not included, enable_app handles its changes.
+ */
+static guint64
+get_input_fingerprint (const gchar *app_name, const gchar *app_version,
+                       const gchar *app_launch_url, const gchar *extension_directory,
+                       const gchar *manifest_file_path, const gchar *generated_app_name)
+{
+    guint64 hash = A2D_HASH_INIT;
+
+    hash = a2d_hash_string (hash, app_name);
+    hash = a2d_hash_string (hash, app_version);
+    hash = a2d_hash_string (hash, app_launch_url);
+    hash = a2d_hash_string (hash, generated_app_name);
+    hash = a2d_hash_string (hash, app_prefix ? app_prefix : "");
+    hash = a2d_hash_string (hash, executable ? executable : "");
+    hash = a2d_hash_string (hash, extension_directory ? extension_directory : "");
+    hash = hash_stat (hash, extension_directory);
+    hash = hash_stat (hash, manifest_file_path);
+
+    /* Set of localizations depends on the system locales */
+    if (g_atomic_int_get (&system_locales_only)) {
+        const gchar * const *languages = g_get_language_names ();
+
+        for (; *languages; languages++)
+            hash = a2d_hash_string (hash, *languages);
+    }
+
+    return hash;
+}
+
+/*
+ * add_job_init:
+ */
+static void
+add_job_init (A2DAddJob *job, A2DBatch *batch, const A2DOperation *operation)
+{
+    memset (job, 0, sizeof (A2DAddJob));
+
+    job->batch = batch;
+    job->operation = operation;
+    job->step = ADD_STEP_RESOLVE;
+    job->ret_val = TRUE;
+}
+
+/*
+ * add_job_clear:
+ */
+static void
+add_job_clear (A2DAddJob *job)
+{
+    if (job->icon_sources)
+        g_ptr_array_free (job->icon_sources, TRUE);
+
+    a2d_manifest_free (job->manifest);
+}
+
+/*
+ * add_step_resolve:
+ *
+ * Resolves the extension directory and finishes apps generated from the same
+ * inputs.
+ */
+static A2DAddStep
+add_step_resolve (A2DAddJob *job)
+{
+    A2DBatch *batch = job->batch;
+    const A2DOperation *operation = job->operation;
+    const gchar *app_id = operation->app_id;
+    const gchar *extension_version;
+    guint64 input_fingerprint;
+
+    job->extension_directory = get_extension_directory_path (batch, app_id);
+    extension_version = get_extension_version (batch, job->extension_directory);
+    job->desktop_file_filename = get_desktop_filename_path (batch, app_id);
+    job->generated_app_name = get_generated_app_name (batch->arena, app_id);
+    job->manifest_file_path = a2d_arena_strconcat (
+        batch->arena, job->extension_directory, MANIFEST_FILE, NULL);
+    input_fingerprint = get_input_fingerprint (operation->app_name, operation->app_version,
+                                               operation->app_launch_url,
+                                               job->extension_directory,
+                                               job->manifest_file_path,
+                                               job->generated_app_name);
+
+    if (app_index && a2d_index_lookup (app_index, app_id, &job->old_record)) {
+        /* Generated from the same inputs */
+        if (job->old_record.input_fingerprint == input_fingerprint &&
+            desktop_file_exists (batch, job->desktop_file_filename)) {
+            a2d_stats_add (A2D_STAT_APPS_UNCHANGED, 1);
+
+            if (job->old_record.enabled != operation->app_enabled)
+                job->ret_val = enable_app (batch, app_id, operation->app_enabled);
+
+            return ADD_STEP_DONE;
+        }
+
+        /* Removed once we know which icons can be kept */
+        job->indexed = TRUE;
+    } else if (desktop_file_exists (batch, job->desktop_file_filename)) {
+        /* Without the index we can't tell what was generated */
+        if (!app_index && !app_updated (job->desktop_file_filename, operation->app_version))
+            return ADD_STEP_DONE;
+        else
+            remove_app (batch, app_id);
+    }
+
+    g_strlcpy (job->record.app_id, app_id, sizeof (job->record.app_id));
+    g_strlcpy (job->record.app_version, operation->app_version,
+               sizeof (job->record.app_version));
+    g_strlcpy (job->record.extension_version, extension_version,
+               sizeof (job->record.extension_version));
+    g_strlcpy (job->record.generated_name, job->generated_app_name,
+               sizeof (job->record.generated_name));
+    job->record.enabled = operation->app_enabled;
+    job->record.input_fingerprint = input_fingerprint;
+
+    return ADD_STEP_MANIFEST;
+}
+
+/*
+ * add_step_manifest:
+ *
+ * Parses the manifest and reads its icons. Files of the previous version are
+ * removed, except for the icons, which can be reused.
+ */
+static A2DAddStep
+add_step_manifest (A2DAddJob *job)
+{
+    A2DBatch *batch = job->batch;
+    GStatBuf stat_buf;
+    guint64 icon_fingerprint;
+    gboolean same_name;
+
+    if (!g_stat (job->manifest_file_path, &stat_buf))
+        job->record.manifest_mtime = stat_buf.st_mtime;
+
+    job->manifest = a2d_manifest_load (job->manifest_file_path);
+    if (!job->manifest) {
+        if (job->indexed)
+            remove_indexed_app (batch, &job->old_record, 0, FALSE);
+
+        job->ret_val = FALSE;
+        return ADD_STEP_DONE;
+    }
+
+    job->icon_sources = get_icon_sources (batch, job->extension_directory,
+                                          job->manifest, &icon_fingerprint);
+
+    if (job->indexed) {
+        same_name = g_strcmp0 (job->old_record.generated_name, job->generated_app_name) == 0;
+
+        /* Scaled icons depend only on the sources and the name */
+        if (job->old_record.icon_fingerprint == icon_fingerprint && same_name)
+            job->kept_icons = job->old_record.generated_icons;
+
+        /* Unchanged .desktop file under the same name isn't rewritten */
+        remove_indexed_app (batch, &job->old_record, job->kept_icons, same_name);
+    }
+
+    job->record.icon_fingerprint = icon_fingerprint;
+
+    return ADD_STEP_DESKTOP_ENTRY;
+}
+
+/*
+ * add_step_desktop_entry:
+ *
+ * Renders and writes the .desktop file.
+ */
+static A2DAddStep
+add_step_desktop_entry (A2DAddJob *job)
+{
+    A2DBatch *batch = job->batch;
+    const A2DOperation *operation = job->operation;
+    A2DDesktopEntry entry;
+    GPtrArray *localizations;
+    gchar *desktop_file_contents;
+    gsize desktop_file_length;
+
+    localizations = get_localizations (batch, job->extension_directory, job->manifest);
+
+    if (app_prefix)
+        entry.name = a2d_arena_strconcat (batch->arena, app_prefix, " - ",
+                                          operation->app_name, NULL);
+    else
+        entry.name = operation->app_name;
+
+    if (*operation->app_launch_url)
+        entry.exec = a2d_arena_strconcat (batch->arena, executable, " --app=",
+                                          operation->app_launch_url, NULL);
+    else
+        entry.exec = a2d_arena_strconcat (batch->arena, executable, " --app-id=",
+                                          operation->app_id, NULL);
+
+    if (*operation->app_launch_url) {
+        entry.startup_wm_class = get_app_wm_class (batch->arena, operation->app_launch_url);
+    } else
+        entry.startup_wm_class = a2d_arena_strconcat (batch->arena, "crx_",
+                                                      operation->app_id, NULL);
+
+    entry.icon = job->generated_app_name;
+    entry.offline_enabled = job->manifest->offline_enabled;
+    entry.hidden = !operation->app_enabled;
+    entry.app_version = operation->app_version;
+    entry.localizations = localizations;
+
+    desktop_file_contents = a2d_desktop_entry_render (&entry, &desktop_file_length);
+    write_desktop_data (batch, job->desktop_file_filename,
+                        desktop_file_contents, desktop_file_length);
+
+    g_free (desktop_file_contents);
+    g_ptr_array_free (localizations, TRUE);
+
+    return ADD_STEP_ICONS;
+}
+
+/*
+ * add_step_icons:
+ *
+ * Installs icons and records the app in the index.
+ */
+static A2DAddStep
+add_step_icons (A2DAddJob *job)
+{
+    install_app_icons (job->batch, job->icon_sources, &job->old_record,
+                       job->kept_icons, &job->record);
+
+    if (app_index)
+        a2d_index_store (app_index, &job->record);
+
+    return ADD_STEP_DONE;
+}
+
+/*
+ * add_app_step:
+ *
+ * Runs the next step of adding app. Returns FALSE when the app is done, the
+ * result is in ret_val then.
+ */
+static gboolean
+add_app_step (A2DAddJob *job)
+{
+    switch (job->step) {
+    case ADD_STEP_RESOLVE:
+        job->step = add_step_resolve (job);
+        break;
+    case ADD_STEP_MANIFEST:
+        job->step = add_step_manifest (job);
+        break;
+    case ADD_STEP_DESKTOP_ENTRY:
+        job->step = add_step_desktop_entry (job);
+        break;
+    case ADD_STEP_ICONS:
+        job->step = add_step_icons (job);
+        break;
+    default:
+        break;
+    }
+
+    if (job->step == ADD_STEP_DONE && job->ret_val)
+        record_first_add ();
+
+    return job->step != ADD_STEP_DONE;
+}
+
+/*
+ * add_app:
+ *
+ * Parses app informations, creates .desktop file and installs app icons.
+ */
+static gboolean
+add_app (A2DBatch *batch, const A2DOperation *operation)
+{
+    A2DAddJob job;
+
+    add_job_init (&job, batch, operation);
+
+    while (add_app_step (&job))
+        ;
+
+    add_job_clear (&job);
+
+    return job.ret_val;
+}
+
+/*
+ * batch_begin:
+ *
+ * Does the setup shared by all operations executed in one batch.
+ */
+static void
+batch_begin (A2DBatch *batch)
+{
+    batch->applications_directory = a2d_paths_get_applications_directory (paths);
+    batch->icon_directory = a2d_paths_get_icon_directory (paths);
+    batch->changed_icon_directories =
+        g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    batch->app_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    batch->commit = a2d_commit_new (g_atomic_int_get (&durability));
+    batch->arena = a2d_arena_new (ARENA_BLOCK_SIZE);
+
+    if (!locale_catalog)
+        locale_catalog = a2d_locale_catalog_new ();
+}
+
+/*
+ * batch_add_app:
+ *
+ * Remembers app the operation is run for.
+ */
+static void
+batch_add_app (A2DBatch *batch, const gchar *app_id)
+{
+    G_LOCK (batch_app_ids);
+
+    if (!g_hash_table_contains (batch->app_ids, app_id))
+        g_hash_table_add (batch->app_ids, g_strdup (app_id));
+
+    G_UNLOCK (batch_app_ids);
+}
+
+/*
+ * invalidate_batch_apps:
+ *
+ * Forgets what was generated for the apps of the batch, so they are
+ * generated again from scratch on next add.
+ */
+static void
+invalidate_batch_apps (A2DBatch *batch)
+{
+    GHashTableIter iter;
+    gpointer app_id;
+
+    if (!app_index)
+        return;
+
+    g_hash_table_iter_init (&iter, batch->app_ids);
+    while (g_hash_table_iter_next (&iter, &app_id, NULL)) {
+        A2DIndexRecord record;
+
+        if (!a2d_index_lookup (app_index, app_id, &record))
+            continue;
+
+        record.input_fingerprint = 0;
+        record.icon_fingerprint = 0;
+        record.generated_icons = 0;
+
+        a2d_index_store (app_index, &record);
+    }
+}
+
+/*
+ * update_icon_theme:
+ *
+ * When icons are installed we need to update modification time of icon's
+ * parent directory to get the icon's cache be rebuilded. Only the size
+ * directories changed in the batch are touched and the theme directory, which
+ * GTK watches, is touched once per batch. Then icon-theme.cache of the theme
+ * is updated, so GTK doesn't have to scan the directories.
+ */
+static void
+update_icon_theme (A2DBatch *batch)
+{
+    GHashTableIter iter;
+    gpointer size_directory;
+
+    if (g_hash_table_size (batch->changed_icon_directories) == 0)
+        return;
+
+    g_hash_table_iter_init (&iter, batch->changed_icon_directories);
+    while (g_hash_table_iter_next (&iter, &size_directory, NULL)) {
+        gchar *path = g_strconcat (batch->icon_directory, size_directory, NULL);
+
+        update_modification_date (path);
+        a2d_stats_add (A2D_STAT_ICON_DIRECTORY_BUMPS, 1);
+
+        g_free (path);
+    }
+
+    update_modification_date (batch->icon_directory);
+    a2d_stats_add (A2D_STAT_ICON_THEME_BUMPS, 1);
+
+    if (!icon_cache)
+        icon_cache = a2d_icon_cache_new (batch->icon_directory);
+
+    a2d_icon_cache_update (icon_cache, batch->changed_icon_directories);
+}
+
+/*
+ * batch_end:
+ *
+ * Finishes the batch. Returns FALSE when writes of the batch weren't
+ * committed, operations of the batch failed then.
+ */
+static gboolean
+batch_end (A2DBatch *batch)
+{
+    gboolean ret_val = a2d_commit_finish (batch->commit);
+
+    if (!ret_val) {
+        a2d_stats_add (A2D_STAT_COMMIT_FAILURES, 1);
+        invalidate_batch_apps (batch);
+    }
+
+    update_icon_theme (batch);
+
+    if (app_index)
+        a2d_index_flush (app_index);
+
+    a2d_arena_free (batch->arena);
+    g_hash_table_destroy (batch->changed_icon_directories);
+    g_hash_table_destroy (batch->app_ids);
+
+    return ret_val;
+}
+
+/*
+ * run_operation:
+ *
+ * Executes one operation as part of the given batch.
+ */
+static gboolean
+run_operation (A2DBatch *batch, const A2DOperation *operation)
+{
+    /* Temporary strings of the previous operation are not needed anymore */
+    a2d_arena_reset (batch->arena);
+    batch_add_app (batch, operation->app_id);
+
+    switch (operation->type) {
+    case A2D_OPERATION_ADD:
+        return add_app (batch, operation);
+    case A2D_OPERATION_REMOVE:
+        return remove_app (batch, operation->app_id);
+    case A2D_OPERATION_ENABLE:
+    case A2D_OPERATION_DISABLE:
+        return enable_app (batch,
+                           operation->app_id,
+                           operation->type == A2D_OPERATION_ENABLE);
+    default:
+        return FALSE;
+    }
+}
+
+/*
+ * record_handled_app:
+ *
+ * Remembers in the running syncs that the user's operation was run for app,
+ * so their pending operations of the app, which were decided before, don't
+ * undo it. Called with running_operations locked.
+ */
+static void
+record_handled_app (const gchar *app_id)
+{
+    GSList *ll;
+
+    for (ll = running_syncs; ll; ll = ll->next) {
+        A2DSyncJob *job = ll->data;
+
+        if (!g_hash_table_contains (job->handled, app_id))
+            g_hash_table_add (job->handled, g_strdup (app_id));
+    }
+}
+
+/*
+ * run_single_operation:
+ *
+ * Executes operation in its own batch.
+ */
+static gboolean
+run_single_operation (const A2DOperation *operation)
+{
+    A2DBatch batch;
+    gboolean ret_val;
+
+    a2d_stats_add (A2D_STAT_OPERATIONS_EXECUTED, 1);
+
+    G_LOCK (running_operations);
+    record_handled_app (operation->app_id);
+    batch_begin (&batch);
+    ret_val = run_operation (&batch, operation);
+    if (!batch_end (&batch))
+        ret_val = FALSE;
+    G_UNLOCK (running_operations);
+
+    return ret_val;
+}
+
+/*
+ * run_operation_task:
+ *
+ * Runs one step of operation in the pool. Adding app is split into steps, so
+ * the threads can take over steps of the apps, which wait for I/O.
+ */
+static gboolean
+run_operation_task (gpointer data, gpointer user_data)
+{
+    A2DOperationTask *task = data;
+
+    if (task->operation->type != A2D_OPERATION_ADD) {
+        *task->result = run_operation (&task->batch, task->operation);
+    } else {
+        if (!task->started) {
+            batch_add_app (&task->batch, task->operation->app_id);
+            add_job_init (&task->add_job, &task->batch, task->operation);
+            task->started = TRUE;
+        }
+
+        if (add_app_step (&task->add_job))
+            return TRUE;
+
+        *task->result = task->add_job.ret_val;
+        add_job_clear (&task->add_job);
+    }
+
+    a2d_arena_free (task->batch.arena);
+    task->batch.arena = NULL;
+
+    return FALSE;
+}
+
+/*
+ * get_pool:
+ *
+ * Returns pool with the configured number of threads or NULL when the
+ * operations should run one after another.
+ */
+static A2DPool *
+get_pool ()
+{
+    guint n_threads = g_atomic_int_get (&threads);
+
+    if (!n_threads)
+        n_threads = MIN (g_get_num_processors (), MAX_POOL_THREADS);
+
+    if (g_atomic_int_get (&cooperative))
+        n_threads = 1;
+
+    if (pool && pool_size != n_threads) {
+        a2d_pool_free (pool);
+        pool = NULL;
+    }
+
+    if (!pool && n_threads > 1) {
+        pool = a2d_pool_new (n_threads, run_operation_task, NULL);
+        pool_size = n_threads;
+    }
+
+    return pool;
+}
+
+/*
+ * run_operations:
+ *
+ * Executes operations as part of the given batch. Operations of one app run
+ * in order, operations of different apps run in parallel.
+ */
+static void
+run_operations (A2DBatch *batch, GPtrArray *operations, gboolean *results)
+{
+    A2DOperationTask *tasks;
+    A2DPool *operations_pool = operations->len > 1 ? get_pool () : NULL;
+    gint64 run_start;
+    guint ii;
+
+    if (!operations_pool) {
+        a2d_stats_add (A2D_STAT_OPERATIONS_EXECUTED, operations->len);
+
+        for (ii = 0; ii < operations->len; ii++)
+            results[ii] = run_operation (batch, g_ptr_array_index (operations, ii));
+
+        return;
+    }
+
+    a2d_stats_add (A2D_STAT_OPERATIONS_EXECUTED, operations->len);
+
+    run_start = a2d_stats_get_time_ns ();
+    tasks = g_new0 (A2DOperationTask, operations->len);
+
+    for (ii = 0; ii < operations->len; ii++) {
+        A2DOperation *operation = g_ptr_array_index (operations, ii);
+
+        tasks[ii].batch = *batch;
+        tasks[ii].batch.arena = a2d_arena_new (ARENA_BLOCK_SIZE);
+        tasks[ii].operation = operation;
+        tasks[ii].result = &results[ii];
+
+        a2d_pool_push (operations_pool, operation->app_id, &tasks[ii]);
+    }
+
+    a2d_pool_wait (operations_pool);
+
+    g_free (tasks);
+
+    a2d_stats_add (A2D_STAT_PARALLEL_OPERATIONS, operations->len);
+    a2d_stats_add (A2D_STAT_PARALLEL_NSEC, a2d_stats_get_time_ns () - run_start);
+}
+
+static A2DAsyncTarget *
+async_target_ref (A2DAsyncTarget *target)
+{
+    g_atomic_int_inc (&target->ref_count);
+
+    return target;
+}
+
+static void
+async_target_unref (A2DAsyncTarget *target)
+{
+    if (g_atomic_int_dec_and_test (&target->ref_count))
+        g_free (target);
+}
+
+/*
+ * complete_operation:
+ *
+ * Delivers result of asynchronous operation to its callback. Runs in the
+ * plugin thread.
+ */
+static void
+complete_operation (void *data)
+{
+    A2DCompletion *completion = data;
+    NPP instance = completion->target->instance;
+    NPObject *callback = completion->operation->callback;
+
+    /* When the instance is gone, so are its objects */
+    if (instance && callback) {
+        NPVariant args[2], value;
+
+        BOOLEAN_TO_NPVARIANT (completion->success, args[0]);
+        STRINGZ_TO_NPVARIANT (completion->operation->app_id, args[1]);
+
+        if (npnfuncs->invokeDefault (instance, callback, args, 2, &value))
+            npnfuncs->releasevariantvalue (&value);
+
+        npnfuncs->releaseobject (callback);
+    }
+
+    async_target_unref (completion->target);
+    a2d_operation_free (completion->operation);
+    g_free (completion);
+}
+
+/*
+ * post_completion:
+ *
+ * Schedules delivery of operation's result in the plugin thread.
+ */
+static void
+post_completion (A2DAsyncTarget *target, A2DOperation *operation, gboolean success)
+{
+    A2DCompletion *completion = g_new0 (A2DCompletion, 1);
+
+    completion->target = async_target_ref (target);
+    completion->operation = operation;
+    completion->success = success;
+
+    npnfuncs->pluginthreadasynccall (target->instance, complete_operation, completion);
+}
+
+/*
+ * coalesce_operations:
+ *
+ * Merges operations of the same app into their net effect, so e.g. app
+ * added and removed right after isn't generated at all. Returns the merged
+ * operations, merged_index maps the operations to them. The first operation
+ * of the app is changed to the merged one. Merged removes, which cancel an add,
+ * are marked in cancels_add.
+ */
+static GPtrArray *
+coalesce_operations (GPtrArray *operations, guint *merged_index, gboolean **cancels_add)
+{
+    GPtrArray *merged = g_ptr_array_sized_new (operations->len);
+    GHashTable *last = g_hash_table_new (g_str_hash, g_str_equal);
+    gboolean *added = g_new0 (gboolean, operations->len);
+    guint ii;
+
+    for (ii = 0; ii < operations->len; ii++) {
+        A2DOperation *operation = g_ptr_array_index (operations, ii);
+        gpointer found = g_hash_table_lookup (last, operation->app_id);
+
+        if (found) {
+            guint jj = GPOINTER_TO_UINT (found) - 1;
+
+            if (a2d_operation_merge (g_ptr_array_index (merged, jj), operation)) {
+                added[jj] |= operation->type == A2D_OPERATION_ADD;
+                merged_index[ii] = jj;
+                continue;
+            }
+        }
+
+        merged_index[ii] = merged->len;
+        added[merged->len] = operation->type == A2D_OPERATION_ADD;
+        g_hash_table_insert (last, operation->app_id, GUINT_TO_POINTER (merged->len + 1));
+        g_ptr_array_add (merged, operation);
+    }
+
+    for (ii = 0; ii < merged->len; ii++) {
+        A2DOperation *operation = g_ptr_array_index (merged, ii);
+
+        added[ii] = added[ii] && operation->type == A2D_OPERATION_REMOVE;
+    }
+
+    g_hash_table_destroy (last);
+
+    a2d_stats_add (A2D_STAT_OPERATIONS_COALESCED, operations->len - merged->len);
+
+    *cancels_add = added;
+
+    return merged;
+}
+
+/*
+ * record_visible_apps:
+ *
+ * Records time from queuing of added apps to the end of their batch, when
+ * their shortcuts become visible.
+ */
+static void
+record_visible_apps (GPtrArray *operations, const gboolean *results)
+{
+    gint64 now = a2d_stats_get_time_ns ();
+    guint ii;
+
+    for (ii = 0; ii < operations->len; ii++) {
+        A2DOperation *operation = g_ptr_array_index (operations, ii);
+
+        if (operation->type != A2D_OPERATION_ADD || !results[ii] || !operation->queued_time)
+            continue;
+
+        a2d_stats_add (A2D_STAT_INTERACTIVE_ADDS, 1);
+        a2d_stats_add (A2D_STAT_INTERACTIVE_ADD_NSEC, now - operation->queued_time);
+        a2d_stats_set_max (A2D_STAT_INTERACTIVE_ADD_MAX_NSEC, now - operation->queued_time);
+    }
+}
+
+/*
+ * process_queued_operations:
+ *
+ * Runs operations queued for the worker thread in one batch. Operations of
+ * the same app are coalesced first, each of them gets the result of the
+ * operation it was merged into.
+ */
+static void
+process_queued_operations (GPtrArray *operations, gpointer user_data)
+{
+    A2DAsyncTarget *target = user_data;
+    A2DBatch batch;
+    GPtrArray *merged;
+    guint *merged_index = g_new0 (guint, operations->len);
+    gboolean *cancels_add;
+    gboolean *results;
+    guint ii;
+
+    merged = coalesce_operations (operations, merged_index, &cancels_add);
+    results = g_new0 (gboolean, merged->len);
+
+    G_LOCK (running_operations);
+    for (ii = 0; ii < merged->len; ii++)
+        record_handled_app (((A2DOperation *) g_ptr_array_index (merged, ii))->app_id);
+
+    batch_begin (&batch);
+    run_operations (&batch, merged, results);
+    if (!batch_end (&batch))
+        memset (results, 0, merged->len * sizeof (gboolean));
+    G_UNLOCK (running_operations);
+
+    record_visible_apps (merged, results);
+
+    /* App that was never generated has nothing to remove */
+    for (ii = 0; ii < merged->len; ii++)
+        results[ii] = results[ii] || cancels_add[ii];
+
+    for (ii = 0; ii < operations->len; ii++)
+        post_completion (target, g_ptr_array_index (operations, ii), results[merged_index[ii]]);
+
+    g_ptr_array_free (merged, TRUE);
+    g_free (merged_index);
+    g_free (cancels_add);
+    g_free (results);
+}
+
+/*
+ * free_queued_operation:
+ *
+ * Drops operation that wasn't processed by the worker thread.
+ */
+static void
+free_queued_operation (gpointer data)
+{
+    A2DOperation *operation = data;
+
+    if (operation->callback)
+        npnfuncs->releaseobject (operation->callback);
+
+    a2d_operation_free (operation);
+}
+
+/*
+ * get_worker:
+ *
+ * Returns worker thread of the plugin instance, it's started when needed.
+ * Returns NULL when the thread can't be created.
+ */
+static A2DWorker *
+get_worker (A2DPluginPrivate *priv)
+{
+    if (!priv->worker)
+        priv->worker = a2d_worker_new (WORKER_QUEUE_DEPTH,
+                                       WORKER_WINDOW,
+                                       process_queued_operations,
+                                       free_queued_operation,
+                                       priv->async_target);
+
+    return priv->worker;
+}
+
+/*
+ * get_object_string_property:
+ *
+ * Returns copy of object's string property owned by the operation or NULL if
+ * the property is missing or it isn't a string.
+ */
+static gchar *
+get_object_string_property (NPP instance, NPObject *object, NPIdentifier property,
+                            A2DOperation *operation)
+{
+    NPVariant value;
+    gchar *ret_val = NULL;
+
+    if (!npnfuncs->getproperty (instance, object, property, &value))
+        return NULL;
+
+    if (NPVARIANT_IS_STRING (value)) {
+        NPString np_string = NPVARIANT_TO_STRING (value);
+        ret_val = a2d_operation_copy_string (operation, np_string.UTF8Characters,
+                                             np_string.UTF8Length);
+    }
+
+    npnfuncs->releasevariantvalue (&value);
+
+    return ret_val;
+}
+
+/*
+ * get_object_boolean_property:
+ *
+ * Returns object's boolean property or default_value if the property is
+ * missing or it isn't a boolean.
+ */
+static gboolean
+get_object_boolean_property (NPP instance, NPObject *object,
+                             NPIdentifier property, gboolean default_value)
+{
+    NPVariant value;
+    gboolean ret_val = default_value;
+
+    if (!npnfuncs->getproperty (instance, object, property, &value))
+        return default_value;
+
+    if (NPVARIANT_IS_BOOLEAN (value))
+        ret_val = NPVARIANT_TO_BOOLEAN (value);
+
+    npnfuncs->releasevariantvalue (&value);
+
+    return ret_val;
+}
+
+/*
+ * get_array_length:
+ *
+ * Returns length of JavaScript array or -1 if the object isn't an array.
+ */
+static gint
+get_array_length (NPP instance, NPObject *array)
+{
+    NPVariant value;
+    gint length = -1;
+
+    if (!npnfuncs->getproperty (instance, array, length_identifier, &value))
+        return -1;
+
+    if (NPVARIANT_IS_INT32 (value))
+        length = NPVARIANT_TO_INT32 (value);
+    else if (NPVARIANT_IS_DOUBLE (value))
+        length = (gint) NPVARIANT_TO_DOUBLE (value);
+
+    npnfuncs->releasevariantvalue (&value);
+
+    return length;
+}
+
+/*
+ * create_window_object:
+ *
+ * Creates new JavaScript object (e.g. "Array" or "Object") in the
+ * instance's window.
+ */
+static NPObject *
+create_window_object (NPP instance, const gchar *constructor)
+{
+    NPObject *window = NULL;
+    NPObject *object = NULL;
+    NPVariant value;
+
+    if (npnfuncs->getvalue (instance, NPNVWindowNPObject, &window) != NPERR_NO_ERROR)
+        return NULL;
+
+    if (npnfuncs->invoke (instance, window,
+                          npnfuncs->getstringidentifier (constructor),
+                          NULL, 0, &value)) {
+        if (NPVARIANT_IS_OBJECT (value))
+            object = NPVARIANT_TO_OBJECT (value);
+        else
+            npnfuncs->releasevariantvalue (&value);
+    }
+
+    npnfuncs->releaseobject (window);
+
+    return object;
+}
+
+/*
+ * set_object_int_property:
+ */
+static void
+set_object_int_property (NPP instance, NPObject *object, const gchar *property, gint value)
+{
+    NPVariant variant;
+
+    INT32_TO_NPVARIANT (value, variant);
+    npnfuncs->setproperty (instance, object,
+                           npnfuncs->getstringidentifier (property),
+                           &variant);
+}
+
+/* Members of operation descriptor, see operation_from_descriptor */
+enum {
+    DESCRIPTOR_OP,
+    DESCRIPTOR_ID,
+    DESCRIPTOR_NAME,
+    DESCRIPTOR_VERSION,
+    DESCRIPTOR_APP_LAUNCH_URL,
+    DESCRIPTOR_ENABLED,
+    DESCRIPTOR_LAST
+};
+
+static const NPUTF8 *descriptor_members[DESCRIPTOR_LAST] = {
+    "op", "id", "name", "version", "appLaunchUrl", "enabled"
+};
+
+static NPIdentifier descriptor_identifiers[DESCRIPTOR_LAST];
+
+/*
+ * operation_from_descriptor:
+ *
+ * Creates operation from JavaScript descriptor. Descriptor is an object with
+ * "op" member ("add", "remove", "enable" or "disable") and with members
+ * named the same as in the chrome.management.ExtensionInfo ("id", "name",
+ * "version", "appLaunchUrl", "enabled"). When the "op" member is missing,
+ * default_type is used.
+ */
+static A2DOperation *
+operation_from_descriptor (NPP instance, NPObject *descriptor,
+                           A2DOperationType default_type)
+{
+    const NPIdentifier *members = descriptor_identifiers;
+    A2DOperation *operation = a2d_operation_new (default_type, NULL);
+    gchar *op;
+
+    op = get_object_string_property (instance, descriptor, members[DESCRIPTOR_OP], operation);
+    if (op)
+        operation->type = a2d_operation_type_from_string (op);
+
+    if (operation->type == A2D_OPERATION_INVALID) {
+        a2d_operation_free (operation);
+        return NULL;
+    }
+
+    operation->app_id = get_object_string_property (
+        instance, descriptor, members[DESCRIPTOR_ID], operation);
+    if (!operation->app_id || !*operation->app_id) {
+        a2d_operation_free (operation);
+        return NULL;
+    }
+
+    if (operation->type != A2D_OPERATION_ADD)
+        return operation;
+
+    operation->app_name = get_object_string_property (
+        instance, descriptor, members[DESCRIPTOR_NAME], operation);
+    operation->app_version = get_object_string_property (
+        instance, descriptor, members[DESCRIPTOR_VERSION], operation);
+    operation->app_launch_url = get_object_string_property (
+        instance, descriptor, members[DESCRIPTOR_APP_LAUNCH_URL], operation);
+    operation->app_enabled = get_object_boolean_property (
+        instance, descriptor, members[DESCRIPTOR_ENABLED], TRUE);
+
+    if (!operation->app_name || !operation->app_version) {
+        a2d_operation_free (operation);
+        return NULL;
+    }
+
+    if (!operation->app_launch_url)
+        operation->app_launch_url = a2d_operation_copy_string (operation, "", 0);
+
+    return operation;
+}
+
+/*
+ * apply_batch:
+ *
+ * Executes all operations from the array of descriptors in one batch and
+ * returns array with status ("ok", "failed" or "invalid") of each of them.
+ */
+static bool
+apply_batch (NPP instance, NPObject *descriptors, NPVariant *result)
+{
+    A2DBatch batch;
+    NPObject *statuses;
+    GPtrArray *parsed, *operations;
+    gboolean *results;
+    gint length, ii;
+    guint jj = 0;
+
+    length = get_array_length (instance, descriptors);
+    if (length < 0)
+        return false;
+
+    statuses = create_window_object (instance, "Array");
+    if (!statuses)
+        return false;
+
+    /* Invalid descriptors are NULL */
+    parsed = g_ptr_array_new_with_free_func ((GDestroyNotify) a2d_operation_free);
+    operations = g_ptr_array_sized_new (length);
+
+    for (ii = 0; ii < length; ii++) {
+        NPVariant descriptor;
+        A2DOperation *operation = NULL;
+
+        if (npnfuncs->getproperty (instance, descriptors, npnfuncs->getintidentifier (ii),
+                                   &descriptor)) {
+            if (NPVARIANT_IS_OBJECT (descriptor))
+                operation = operation_from_descriptor (
+                    instance, NPVARIANT_TO_OBJECT (descriptor),
+                    A2D_OPERATION_INVALID);
+
+            npnfuncs->releasevariantvalue (&descriptor);
+        }
+
+        g_ptr_array_add (parsed, operation);
+        if (operation)
+            g_ptr_array_add (operations, operation);
+    }
+
+    results = g_new0 (gboolean, operations->len);
+
+    G_LOCK (running_operations);
+    for (ii = 0; ii < operations->len; ii++)
+        record_handled_app (((A2DOperation *) g_ptr_array_index (operations, ii))->app_id);
+
+    batch_begin (&batch);
+    run_operations (&batch, operations, results);
+    if (!batch_end (&batch))
+        memset (results, 0, operations->len * sizeof (gboolean));
+    G_UNLOCK (running_operations);
+
+    for (ii = 0; ii < length; ii++) {
+        NPVariant status;
+        const gchar *operation_status = STATUS_INVALID;
+
+        if (g_ptr_array_index (parsed, ii))
+            operation_status = results[jj++] ? STATUS_OK : STATUS_FAILED;
+
+        STRINGZ_TO_NPVARIANT (operation_status, status);
+        npnfuncs->setproperty (instance, statuses, npnfuncs->getintidentifier (ii), &status);
+    }
+
+    g_free (results);
+    g_ptr_array_free (operations, TRUE);
+    g_ptr_array_free (parsed, TRUE);
+
+    OBJECT_TO_NPVARIANT (statuses, *result);
+
+    return true;
+}
+
+/*
+ * sync_operation:
+ *
+ * Turns add operation of app the browser has into the minimal operation
+ * needed. Returns FALSE when there is nothing to do.
+ */
+static gboolean
+sync_operation (A2DBatch *batch, A2DOperation *operation, A2DSyncResult *sync_result,
+                guint *indexed)
+{
+    A2DIndexRecord record;
+    const gchar *generated_app_name;
+    gboolean same;
+
+    a2d_arena_reset (batch->arena);
+
+    if (!app_index || !a2d_index_lookup (app_index, operation->app_id, &record)) {
+        sync_result->created++;
+        return TRUE;
+    }
+
+    (*indexed)++;
+
+    generated_app_name = get_generated_app_name (batch->arena, operation->app_id);
+    same = g_strcmp0 (record.app_version, operation->app_version) == 0 &&
+           g_strcmp0 (record.generated_name, generated_app_name) == 0;
+
+    if (same && record.enabled == operation->app_enabled) {
+        sync_result->skipped++;
+        return FALSE;
+    }
+
+    if (same)
+        operation->type = operation->app_enabled ? A2D_OPERATION_ENABLE : A2D_OPERATION_DISABLE;
+
+    sync_result->updated++;
+
+    return TRUE;
+}
+
+/*
+ * compare_launch_times:
+ *
+ * Orders operations of recently launched apps first.
+ */
+static gint
+compare_launch_times (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    A2DPreferences *preferences = user_data;
+    const A2DOperation *operation_a = *(A2DOperation **) a;
+    const A2DOperation *operation_b = *(A2DOperation **) b;
+    gint64 launch_time_a = a2d_preferences_get_last_launch_time (preferences, operation_a->app_id);
+    gint64 launch_time_b = a2d_preferences_get_last_launch_time (preferences, operation_b->app_id);
+
+    if (launch_time_a == launch_time_b)
+        return 0;
+
+    return launch_time_a > launch_time_b ? -1 : 1;
+}
+
+/*
+ * sync_job_fail_batch:
+ *
+ * Marks pending operations run in the batch, which wasn't committed, as
+ * failed.
+ */
+static void
+sync_job_fail_batch (A2DSyncJob *job)
+{
+    guint ii;
+
+    for (ii = job->batch_start; ii < job->next; ii++)
+        job->results[ii] = FALSE;
+}
+
+/*
+ * sync_job_is_superseded:
+ *
+ * Checks whether the user's operation was run for app of the pending
+ * operation since the sync was prepared. The pending operation is dropped
+ * then, the user's one is newer.
+ */
+static gboolean
+sync_job_is_superseded (A2DSyncJob *job, guint index)
+{
+    A2DOperation *operation = g_ptr_array_index (job->pending, index);
+
+    if (!g_hash_table_contains (job->handled, operation->app_id))
+        return FALSE;
+
+    job->superseded[index] = TRUE;
+    a2d_stats_add (A2D_STAT_SYNC_SUPERSEDED, 1);
+
+    return TRUE;
+}
+
+/*
+ * run_bulk_operations:
+ *
+ * Executes pending operations of asynchronous sync. Between them the
+ * operations queued meanwhile run first in their own batch, so e.g. app
+ * installed by the user doesn't wait for sync of all apps. With the pool the
+ * operations run in chunks of one operation per thread. Every chunk is a batch
+ * of its own and running_operations is locked only for it, so synchronous
+ * operations and workers of other instances don't wait for the whole sync.
+ */
+static void
+run_bulk_operations (A2DSyncJob *job)
+{
+    A2DPool *operations_pool = get_pool ();
+    guint chunk_size = operations_pool ? a2d_pool_get_n_threads (operations_pool) : 1;
+    GPtrArray *chunk = g_ptr_array_sized_new (chunk_size);
+    guint *indexes = g_new (guint, chunk_size);
+    gboolean *chunk_results = g_new (gboolean, chunk_size);
+    A2DBatch batch;
+    guint ii;
+
+    while (job->next < job->pending->len) {
+        if (a2d_worker_is_stopping (job->worker))
+            break;
+
+        if (a2d_worker_get_depth (job->worker) > 0) {
+            a2d_worker_run_interactive (job->worker);
+            a2d_stats_add (A2D_STAT_BULK_YIELDS, 1);
+        }
+
+        G_LOCK (running_operations);
+        batch_begin (&batch);
+        job->batch_start = job->next;
+
+        g_ptr_array_set_size (chunk, 0);
+        for (; job->next < job->pending->len && chunk->len < chunk_size; job->next++) {
+            if (sync_job_is_superseded (job, job->next))
+                continue;
+
+            indexes[chunk->len] = job->next;
+            g_ptr_array_add (chunk, g_ptr_array_index (job->pending, job->next));
+        }
+
+        run_operations (&batch, chunk, chunk_results);
+
+        for (ii = 0; ii < chunk->len; ii++)
+            job->results[indexes[ii]] = chunk_results[ii];
+
+        if (!batch_end (&batch))
+            sync_job_fail_batch (job);
+        G_UNLOCK (running_operations);
+    }
+
+    g_free (chunk_results);
+    g_free (indexes);
+    g_ptr_array_free (chunk, TRUE);
+}
+
+/*
+ * sync_job_prepare:
+ *
+ * Finds out what the sync has to do. Apps that aren't in the job are removed,
+ * new ones are added and changed ones are updated. Recently launched apps are
+ * updated first. Called with running_operations locked.
+ */
+static void
+sync_job_prepare (A2DSyncJob *job, A2DBatch *batch)
+{
+    A2DPreferences *preferences;
+    GHashTable *listed;
+    guint indexed = 0;
+    guint ii;
+
+    listed = g_hash_table_new (g_str_hash, g_str_equal);
+    /* Updates are owned by the job, removals by the array */
+    job->pending = g_ptr_array_new ();
+
+    for (ii = 0; ii < job->operations->len; ii++) {
+        A2DOperation *operation = g_ptr_array_index (job->operations, ii);
+
+        g_hash_table_add (listed, operation->app_id);
+
+        if (sync_operation (batch, operation, &job->result, &indexed))
+            g_ptr_array_add (job->pending, operation);
+    }
+
+    preferences = a2d_preferences_load (a2d_paths_get_preferences_file (paths));
+    if (preferences) {
+        g_ptr_array_sort_with_data (job->pending, compare_launch_times, preferences);
+        a2d_preferences_free (preferences);
+    }
+
+    job->n_updates = job->pending->len;
+
+    /* Remove apps the browser doesn't have anymore, all of them are in the
+     * index. When all indexed apps were listed, there is nothing to remove. */
+    if (app_index && a2d_index_get_size (app_index) > indexed) {
+        GPtrArray *app_ids = a2d_index_get_app_ids (app_index);
+
+        for (ii = 0; ii < app_ids->len; ii++) {
+            const gchar *app_id = g_ptr_array_index (app_ids, ii);
+
+            if (!g_hash_table_contains (listed, app_id))
+                g_ptr_array_add (job->pending, a2d_operation_new (A2D_OPERATION_REMOVE, app_id));
+        }
+
+        g_ptr_array_free (app_ids, TRUE);
+    }
+
+    job->results = g_new0 (gboolean, job->pending->len);
+    job->superseded = g_new0 (gboolean, job->pending->len);
+
+    /* Operations the user runs from now on supersede the pending ones */
+    job->handled = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    running_syncs = g_slist_prepend (running_syncs, job);
+
+    g_hash_table_destroy (listed);
+}
+
+/*
+ * sync_job_clear_pending:
+ */
+static void
+sync_job_clear_pending (A2DSyncJob *job)
+{
+    guint ii;
+
+    if (!job->pending)
+        return;
+
+    G_LOCK (running_operations);
+    running_syncs = g_slist_remove (running_syncs, job);
+    G_UNLOCK (running_operations);
+
+    for (ii = job->n_updates; ii < job->pending->len; ii++)
+        a2d_operation_free (g_ptr_array_index (job->pending, ii));
+
+    g_ptr_array_free (job->pending, TRUE);
+    job->pending = NULL;
+    g_free (job->results);
+    job->results = NULL;
+    g_free (job->superseded);
+    job->superseded = NULL;
+    g_hash_table_destroy (job->handled);
+    job->handled = NULL;
+}
+
+/*
+ * sync_job_free:
+ */
+static void
+sync_job_free (gpointer data)
+{
+    A2DSyncJob *job = data;
+
+    /* When the instance is gone, so are its objects */
+    if (job->callback && job->target->instance)
+        npnfuncs->releaseobject (job->callback);
+
+    if (job->target)
+        async_target_unref (job->target);
+
+    sync_job_clear_pending (job);
+    g_ptr_array_free (job->operations, TRUE);
+    g_free (job);
+}
+
+/*
+ * sync_job_finish:
+ *
+ * Counts results of the pending operations.
+ */
+static void
+sync_job_finish (A2DSyncJob *job)
+{
+    guint ii;
+
+    for (ii = 0; ii < job->pending->len; ii++) {
+        if (job->superseded[ii])
+            job->result.superseded++;
+        else if (ii >= job->n_updates && job->results[ii])
+            job->result.removed++;
+        else if (!job->results[ii])
+            job->result.failed++;
+    }
+
+    sync_job_clear_pending (job);
+}
+
+/*
+ * run_sync:
+ *
+ * Makes generated apps match the apps of the job.
+ */
+static void
+run_sync (A2DSyncJob *job)
+{
+    A2DBatch batch;
+
+    G_LOCK (running_operations);
+    batch_begin (&batch);
+
+    sync_job_prepare (job, &batch);
+
+    /* Updates and removals of different apps, so all of them can run in
+     * parallel */
+    if (!job->worker) {
+        run_operations (&batch, job->pending, job->results);
+        job->next = job->pending->len;
+    }
+
+    if (!batch_end (&batch))
+        sync_job_fail_batch (job);
+    G_UNLOCK (running_operations);
+
+    if (job->worker)
+        run_bulk_operations (job);
+
+    sync_job_finish (job);
+}
+
+/*
+ * set_sync_counts:
+ */
+static void
+set_sync_counts (NPP instance, NPObject *counts, const A2DSyncResult *sync_result)
+{
+    set_object_int_property (instance, counts, "created", sync_result->created);
+    set_object_int_property (instance, counts, "updated", sync_result->updated);
+    set_object_int_property (instance, counts, "removed", sync_result->removed);
+    set_object_int_property (instance, counts, "skipped", sync_result->skipped);
+    set_object_int_property (instance, counts, "failed", sync_result->failed);
+    set_object_int_property (instance, counts, "superseded", sync_result->superseded);
+}
+
+/*
+ * complete_sync:
+ *
+ * Delivers counts of asynchronous sync to its callback. Runs in the plugin
+ * thread.
+ */
+static void
+complete_sync (void *data)
+{
+    A2DSyncJob *job = data;
+    NPP instance = job->target->instance;
+    NPObject *counts;
+
+    /* When the instance is gone, so are its objects */
+    if (instance && (counts = create_window_object (instance, "Object"))) {
+        NPVariant args[1], value;
+
+        set_sync_counts (instance, counts, &job->result);
+        OBJECT_TO_NPVARIANT (counts, args[0]);
+
+        if (npnfuncs->invokeDefault (instance, job->callback, args, 1, &value))
+            npnfuncs->releasevariantvalue (&value);
+
+        npnfuncs->releaseobject (counts);
+    }
+
+    sync_job_free (job);
+}
+
+/*
+ * run_sync_job:
+ *
+ * Runs asynchronous sync in the worker thread.
+ */
+static void
+run_sync_job (gpointer data, gpointer user_data)
+{
+    A2DSyncJob *job = data;
+
+    run_sync (job);
+
+    npnfuncs->pluginthreadasynccall (job->target->instance, complete_sync, job);
+}
+
+/*
+ * sync_job_step:
+ *
+ * Does the next part of sync processed in slices, the preparation or one of
+ * the pending operations. Returns TRUE when the sync is done.
+ */
+static gboolean
+sync_job_step (A2DSyncJob *job, A2DBatch *batch)
+{
+    if (!job->pending) {
+        sync_job_prepare (job, batch);
+    } else if (!sync_job_is_superseded (job, job->next)) {
+        a2d_stats_add (A2D_STAT_OPERATIONS_EXECUTED, 1);
+        job->results[job->next] = run_operation (batch, g_ptr_array_index (job->pending, job->next));
+        job->next++;
+    } else {
+        job->next++;
+    }
+
+    return job->next >= job->pending->len;
+}
+
+/*
+ * run_slice:
+ *
+ * Processes operations queued for the slicer until the budget of the slice
+ * is used up, the queued operations go before the sync. At least one
+ * operation is processed, so the processing moves on even when it takes
+ * longer than the budget. Runs in the plugin thread.
+ */
+static void
+run_slice (void *data)
+{
+    A2DSlicer *slicer = data;
+    A2DBatch batch;
+    GPtrArray *finished;
+    GArray *results;
+    GSList *finished_syncs = NULL, *stepped_syncs = NULL, *ll;
+    gint64 start, elapsed;
+    guint ii;
+
+    slicer->scheduled = FALSE;
+
+    /* Plugin was destroyed meanwhile and left the slicer to us */
+    if (!slicer->target->instance) {
+        async_target_unref (slicer->target);
+        g_free (slicer);
+        return;
+    }
+
+    start = a2d_stats_get_time_ns ();
+    finished = g_ptr_array_new ();
+    results = g_array_new (FALSE, FALSE, sizeof (gboolean));
+
+    G_LOCK (running_operations);
+    batch_begin (&batch);
+
+    do {
+        A2DOperation *operation = g_queue_pop_head (&slicer->operations);
+        A2DSyncJob *job;
+
+        if (operation) {
+            gboolean success;
+
+            record_handled_app (operation->app_id);
+            success = run_operation (&batch, operation);
+
+            a2d_stats_add (A2D_STAT_OPERATIONS_EXECUTED, 1);
+            g_ptr_array_add (finished, operation);
+            g_array_append_val (results, success);
+        } else if ((job = g_queue_peek_head (&slicer->syncs))) {
+            if (!g_slist_find (stepped_syncs, job)) {
+                stepped_syncs = g_slist_prepend (stepped_syncs, job);
+                job->batch_start = job->next;
+            }
+
+            if (sync_job_step (job, &batch))
+                finished_syncs = g_slist_prepend (finished_syncs, g_queue_pop_head (&slicer->syncs));
+        } else {
+            break;
+        }
+    } while (a2d_stats_get_time_ns () - start < (gint64) SLICE_BUDGET * 1000000);
+
+    if (!batch_end (&batch)) {
+        memset (results->data, 0, results->len * sizeof (gboolean));
+
+        for (ll = stepped_syncs; ll; ll = ll->next)
+            sync_job_fail_batch (ll->data);
+    }
+    G_UNLOCK (running_operations);
+
+    g_slist_free (stepped_syncs);
+
+    elapsed = a2d_stats_get_time_ns () - start;
+    a2d_stats_add (A2D_STAT_SLICES, 1);
+    a2d_stats_add (A2D_STAT_SLICE_NSEC, elapsed);
+    a2d_stats_set_max (A2D_STAT_SLICE_MAX_NSEC, elapsed);
+
+    record_visible_apps (finished, (gboolean *) results->data);
+
+    for (ii = 0; ii < finished->len; ii++)
+        post_completion (slicer->target, g_ptr_array_index (finished, ii),
+                         g_array_index (results, gboolean, ii));
+
+    finished_syncs = g_slist_reverse (finished_syncs);
+    for (ll = finished_syncs; ll; ll = ll->next) {
+        A2DSyncJob *job = ll->data;
+
+        sync_job_finish (job);
+        npnfuncs->pluginthreadasynccall (slicer->target->instance, complete_sync, job);
+    }
+
+    g_slist_free (finished_syncs);
+    g_array_free (results, TRUE);
+    g_ptr_array_free (finished, TRUE);
+
+    /* Lets the browser run its event loop before the next slice */
+    if (!g_queue_is_empty (&slicer->operations) || !g_queue_is_empty (&slicer->syncs)) {
+        slicer->scheduled = TRUE;
+        npnfuncs->pluginthreadasynccall (slicer->target->instance, run_slice, slicer);
+    }
+}
+
+/*
+ * schedule_slice:
+ *
+ * Runs slice of the slicer, unless one is already scheduled.
+ */
+static void
+schedule_slice (A2DSlicer *slicer)
+{
+    if (slicer->scheduled)
+        return;
+
+    slicer->scheduled = TRUE;
+    npnfuncs->pluginthreadasynccall (slicer->target->instance, run_slice, slicer);
+}
+
+/*
+ * slicer_new:
+ */
+static A2DSlicer *
+slicer_new (A2DAsyncTarget *target)
+{
+    A2DSlicer *slicer = g_new0 (A2DSlicer, 1);
+
+    slicer->target = async_target_ref (target);
+    g_queue_init (&slicer->operations);
+    g_queue_init (&slicer->syncs);
+
+    return slicer;
+}
+
+/*
+ * slicer_free:
+ *
+ * Drops operations, which weren't processed. When a slice is scheduled, the
+ * slicer is freed by it.
+ */
+static void
+slicer_free (A2DSlicer *slicer)
+{
+    A2DOperation *operation;
+    A2DSyncJob *job;
+
+    if (!slicer)
+        return;
+
+    while ((operation = g_queue_pop_head (&slicer->operations)))
+        free_queued_operation (operation);
+
+    while ((job = g_queue_pop_head (&slicer->syncs)))
+        sync_job_free (job);
+
+    if (slicer->scheduled)
+        return;
+
+    async_target_unref (slicer->target);
+    g_free (slicer);
+}
+
+/*
+ * use_slicer:
+ *
+ * Returns TRUE when operations of the plugin instance are processed in
+ * slices, which is when cooperative is set or the worker thread can't be
+ * created.
+ */
+static gboolean
+use_slicer (A2DPluginPrivate *priv)
+{
+    if (g_atomic_int_get (&cooperative) || !get_worker (priv)) {
+        if (!priv->slicer)
+            priv->slicer = slicer_new (priv->async_target);
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * queue_operation:
+ *
+ * Queues operation for the worker thread or the slicer, its result is passed to the
+ * callback. Invocation's result is the queue depth or -1 when the queue is
+ * full and the operation was rejected.
+ */
+static bool
+queue_operation (NPObject *obj, A2DOperation *operation, NPObject *callback,
+                 NPVariant *result)
+{
+    NPP instance = ((A2DScriptableObject *) obj)->instance;
+    A2DPluginPrivate *priv = A2D_PLUGIN (instance->pdata)->priv;
+    gint depth;
+
+    operation->callback = npnfuncs->retainobject (callback);
+    operation->queued_time = a2d_stats_get_time_ns ();
+
+    if (use_slicer (priv)) {
+        g_queue_push_tail (&priv->slicer->operations, operation);
+        schedule_slice (priv->slicer);
+        INT32_TO_NPVARIANT (g_queue_get_length (&priv->slicer->operations), *result);
+
+        return true;
+    }
+
+    depth = a2d_worker_push (priv->worker, operation);
+    if (depth < 0)
+        free_queued_operation (operation);
+
+    INT32_TO_NPVARIANT (depth, *result);
+
+    return true;
+}
+
+/*
+ * sync_apps:
+ *
+ * Makes generated apps match the array of apps the browser has (objects
+ * like chrome.management.ExtensionInfo). Returns object with counts of
+ * created, updated, removed, skipped and failed operations. With callback
+ * the sync runs in the worker thread after the queued operations and the
+ * counts are passed to the callback.
+ */
+static bool
+sync_apps (NPObject *obj, NPObject *infos, NPObject *callback, NPVariant *result)
+{
+    NPP instance = ((A2DScriptableObject *) obj)->instance;
+    A2DPluginPrivate *priv = A2D_PLUGIN (instance->pdata)->priv;
+    A2DSyncJob *job;
+    NPObject *counts = NULL;
+    GHashTable *listed;
+    gint length, ii;
+
+    length = get_array_length (instance, infos);
+    if (length < 0)
+        return false;
+
+    if (!callback) {
+        counts = create_window_object (instance, "Object");
+        if (!counts)
             return false;
+    }
+
+    job = g_new0 (A2DSyncJob, 1);
+    job->operations = g_ptr_array_new_with_free_func ((GDestroyNotify) a2d_operation_free);
+
+    listed = g_hash_table_new (g_str_hash, g_str_equal);
+
+    for (ii = 0; ii < length; ii++) {
+        NPVariant info;
+        A2DOperation *operation = NULL;
+
+        if (npnfuncs->getproperty (instance, infos, npnfuncs->getintidentifier (ii), &info)) {
+            if (NPVARIANT_IS_OBJECT (info))
+                operation = operation_from_descriptor (
+                    instance, NPVARIANT_TO_OBJECT (info),
+                    A2D_OPERATION_ADD);
+
+            npnfuncs->releasevariantvalue (&info);
+        }
+
+        if (!operation || operation->type != A2D_OPERATION_ADD) {
+            job->result.failed++;
+            a2d_operation_free (operation);
+            continue;
+        }
+
+        if (g_hash_table_contains (listed, operation->app_id)) {
+            a2d_operation_free (operation);
+            continue;
+        }
+
+        g_hash_table_add (listed, operation->app_id);
+        g_ptr_array_add (job->operations, operation);
+    }
+
+    g_hash_table_destroy (listed);
+
+    if (!callback) {
+        run_sync (job);
+        set_sync_counts (instance, counts, &job->result);
+        sync_job_free (job);
+
+        OBJECT_TO_NPVARIANT (counts, *result);
+
+        return true;
+    }
+
+    job->callback = npnfuncs->retainobject (callback);
+    job->target = async_target_ref (priv->async_target);
+
+    if (use_slicer (priv)) {
+        g_queue_push_tail (&priv->slicer->syncs, job);
+        schedule_slice (priv->slicer);
+    } else {
+        job->worker = priv->worker;
+        a2d_worker_push_bulk (job->worker, run_sync_job, job, sync_job_free);
+    }
+
+    VOID_TO_NPVARIANT (*result);
+
+    return true;
+}
+
+NPObject*
+np_class_allocate(NPP instance, NPClass* npclass)
+{
+    A2DScriptableObject *object = g_new0 (A2DScriptableObject, 1);
+
+    object->instance = instance;
+
+    return (NPObject *) object;
+}
+
+void
+np_class_deallocate(NPObject* obj)
+{
+    g_free (obj);
+}
+
+/*
+ * invoke_add:
+ */
+static bool
+invoke_add (NPObject* obj, const NPVariant* args, uint32_t arg_count, NPVariant* result)
+{
+    gboolean ret_val = FALSE;
+    A2DOperation *operation;
+
+    /* 5 arguments */
+    /* 1 - app name */
+    /* 2 - app id */
+    /* 3 - app version */
+    /* 4 - launch url */
+    /* 5 - enabled ? */
+    /* 6 - optional callback, operation is asynchronous when given */
+    if (arg_count != 5 && arg_count != 6)
+        return false;
+
+    if (!(NPVARIANT_IS_STRING (args[0]) && NPVARIANT_IS_STRING (args[1]) && NPVARIANT_IS_STRING (args[2]) &&
+                NPVARIANT_IS_STRING (args[3]) && NPVARIANT_IS_BOOLEAN (args[4])))
+        return false;
+
+    if (arg_count == 6 && !NPVARIANT_IS_OBJECT (args[5]))
+        return false;
 
-        NPString np_app_name = NPVARIANT_TO_STRING(args[0]);
-        app_name = g_strndup (np_app_name.UTF8Characters, np_app_name.UTF8Length);
-        NPString np_app_id = NPVARIANT_TO_STRING(args[1]);
-        app_id = g_strndup (np_app_id.UTF8Characters, np_app_id.UTF8Length);
-        NPString np_app_version = NPVARIANT_TO_STRING(args[2]);
-        app_version = g_strndup (np_app_version.UTF8Characters, np_app_version.UTF8Length);
-        NPString np_app_launch_url = NPVARIANT_TO_STRING(args[3]);
-        app_launch_url = g_strndup (np_app_launch_url.UTF8Characters, np_app_launch_url.UTF8Length);
-        NPBool app_enabled = NPVARIANT_TO_BOOLEAN(args[4]);
+    operation = a2d_operation_new (A2D_OPERATION_ADD, NULL);
 
-        ret_val = add_app (app_name, app_id, app_version, app_launch_url, app_enabled);
+    NPString np_app_name = NPVARIANT_TO_STRING(args[0]);
+    operation->app_name = a2d_operation_copy_string (
+        operation, np_app_name.UTF8Characters, np_app_name.UTF8Length);
+    NPString np_app_id = NPVARIANT_TO_STRING(args[1]);
+    operation->app_id = a2d_operation_copy_string (
+        operation, np_app_id.UTF8Characters, np_app_id.UTF8Length);
+    NPString np_app_version = NPVARIANT_TO_STRING(args[2]);
+    operation->app_version = a2d_operation_copy_string (
+        operation, np_app_version.UTF8Characters, np_app_version.UTF8Length);
+    NPString np_app_launch_url = NPVARIANT_TO_STRING(args[3]);
+    operation->app_launch_url = a2d_operation_copy_string (
+        operation, np_app_launch_url.UTF8Characters, np_app_launch_url.UTF8Length);
+    operation->app_enabled = NPVARIANT_TO_BOOLEAN(args[4]);
 
-        g_free (app_name);
-        g_free (app_id);
-        g_free (app_version);
-        g_free (app_launch_url);
+    if (arg_count == 6)
+        return queue_operation (obj, operation, NPVARIANT_TO_OBJECT (args[5]), result);
 
-        return ret_val;
-    } else if (method_name == remove_id) {
-        gboolean ret_val = FALSE;
-        gchar *app_id;
+    ret_val = run_single_operation (operation);
+    a2d_operation_free (operation);
 
-        /* 1 argument */
-        /* 1 - app id */
-        if (arg_count != 1)
-            return false;
+    return ret_val;
+}
 
-        if (!NPVARIANT_IS_STRING (args[0]))
-            return false;
+/*
+ * invoke_app_id_operation:
+ *
+ * Invokes operation that takes only app id.
+ */
+static bool
+invoke_app_id_operation (NPObject* obj, A2DOperationType type,
+                         const NPVariant* args, uint32_t arg_count, NPVariant* result)
+{
+    gboolean ret_val = FALSE;
+    A2DOperation *operation;
 
-        NPString np_app_id = NPVARIANT_TO_STRING(args[0]);
-        app_id = g_strndup (np_app_id.UTF8Characters, np_app_id.UTF8Length);
+    /* 1 argument */
+    /* 1 - app id */
+    /* 2 - optional callback, operation is asynchronous when given */
+    if (arg_count != 1 && arg_count != 2)
+        return false;
 
-        ret_val = remove_app (app_id);
-        g_free (app_id);
+    if (!NPVARIANT_IS_STRING (args[0]))
+        return false;
 
-        return ret_val;
-    } else if (method_name == enable_id || method_name == disable_id) {
-        gboolean ret_val = FALSE;
-        gchar *app_id;
+    if (arg_count == 2 && !NPVARIANT_IS_OBJECT (args[1]))
+        return false;
 
-        /* 1 argument */
-        /* 1 - app id */
-        if (arg_count != 1)
-            return false;
+    operation = a2d_operation_new (type, NULL);
 
-        if (!NPVARIANT_IS_STRING (args[0]))
-            return false;
+    NPString np_app_id = NPVARIANT_TO_STRING(args[0]);
+    operation->app_id = a2d_operation_copy_string (
+        operation, np_app_id.UTF8Characters, np_app_id.UTF8Length);
 
-        NPString np_app_id = NPVARIANT_TO_STRING(args[0]);
-        app_id = g_strndup (np_app_id.UTF8Characters, np_app_id.UTF8Length);
+    if (arg_count == 2)
+        return queue_operation (obj, operation, NPVARIANT_TO_OBJECT (args[1]), result);
 
-        ret_val = enable_app (app_id, method_name == enable_id);
-        g_free (app_id);
+    ret_val = run_single_operation (operation);
+    a2d_operation_free (operation);
 
-        return ret_val;
-    } else {
-        npnfuncs->setexception(obj, "Unknown method");
+    return ret_val;
+}
+
+static bool
+invoke_remove (NPObject* obj, const NPVariant* args, uint32_t arg_count, NPVariant* result)
+{
+    return invoke_app_id_operation (obj, A2D_OPERATION_REMOVE, args, arg_count, result);
+}
+
+static bool
+invoke_enable (NPObject* obj, const NPVariant* args, uint32_t arg_count, NPVariant* result)
+{
+    return invoke_app_id_operation (obj, A2D_OPERATION_ENABLE, args, arg_count, result);
+}
+
+static bool
+invoke_disable (NPObject* obj, const NPVariant* args, uint32_t arg_count, NPVariant* result)
+{
+    return invoke_app_id_operation (obj, A2D_OPERATION_DISABLE, args, arg_count, result);
+}
+
+/*
+ * invoke_apply_batch:
+ */
+static bool
+invoke_apply_batch (NPObject* obj, const NPVariant* args, uint32_t arg_count, NPVariant* result)
+{
+    /* 1 argument */
+    /* 1 - array of operation descriptors */
+    if (arg_count != 1)
+        return false;
+
+    if (!NPVARIANT_IS_OBJECT (args[0]))
+        return false;
+
+    return apply_batch (((A2DScriptableObject *) obj)->instance,
+                        NPVARIANT_TO_OBJECT (args[0]),
+                        result);
+}
+
+/*
+ * invoke_sync:
+ */
+static bool
+invoke_sync (NPObject* obj, const NPVariant* args, uint32_t arg_count, NPVariant* result)
+{
+    /* 1 or 2 arguments */
+    /* 1 - array of all apps */
+    /* 2 - optional callback receiving the counts */
+    if (arg_count != 1 && arg_count != 2)
+        return false;
+
+    if (!NPVARIANT_IS_OBJECT (args[0]))
+        return false;
+
+    if (arg_count == 2 && !NPVARIANT_IS_OBJECT (args[1]))
+        return false;
+
+    return sync_apps (obj,
+                      NPVARIANT_TO_OBJECT (args[0]),
+                      arg_count == 2 ? NPVARIANT_TO_OBJECT (args[1]) : NULL,
+                      result);
+}
+
+/*
+ * get_queue_depth:
+ *
+ * Returns number of operations waiting for the worker thread or the slicer.
+ */
+static bool
+get_queue_depth (NPObject* obj, NPVariant* result)
+{
+    NPP instance = ((A2DScriptableObject *) obj)->instance;
+    A2DPluginPrivate *priv = A2D_PLUGIN (instance->pdata)->priv;
+
+    gint depth = 0;
+
+    if (priv->worker)
+        depth += a2d_worker_get_depth (priv->worker);
+
+    if (priv->slicer)
+        depth += g_queue_get_length (&priv->slicer->operations);
+
+    INT32_TO_NPVARIANT (depth, *result);
+
+    return true;
+}
+
+/*
+ * get_stats:
+ *
+ * Returns object with all counters.
+ */
+static bool
+get_stats (NPObject* obj, NPVariant* result)
+{
+    NPP instance = ((A2DScriptableObject *) obj)->instance;
+    NPObject *stats;
+    A2DStat stat;
+
+    stats = create_window_object (instance, "Object");
+    if (!stats)
+        return false;
+
+    for (stat = 0; stat < A2D_STAT_LAST; stat++) {
+        NPVariant value;
+
+        DOUBLE_TO_NPVARIANT ((double) a2d_stats_get (stat), value);
+        npnfuncs->setproperty (instance, stats,
+                               npnfuncs->getstringidentifier (a2d_stats_get_name (stat)),
+                               &value);
+    }
+
+    OBJECT_TO_NPVARIANT (stats, *result);
+
+    return true;
+}
+
+/*
+ * get_durability:
+ *
+ * Returns name of the durability mode used for writing .desktop files.
+ */
+static bool
+get_durability (NPObject* obj, NPVariant* result)
+{
+    const gchar *name = a2d_durability_to_string (g_atomic_int_get (&durability));
+    gsize length = strlen (name);
+    NPUTF8 *value = npnfuncs->memalloc (length + 1);
+
+    if (!value)
+        return false;
+
+    memcpy (value, name, length + 1);
+    STRINGN_TO_NPVARIANT (value, length, *result);
+
+    return true;
+}
+
+/*
+ * set_durability:
+ *
+ * Selects durability mode for the following batches: "fsync" syncs every
+ * file, "group" syncs all files of a batch at once and "none" doesn't sync.
+ */
+static bool
+set_durability (NPObject* obj, const NPVariant* value)
+{
+    A2DDurability mode;
+    gchar *name;
+
+    if (!NPVARIANT_IS_STRING (*value))
+        return false;
+
+    name = g_strndup (NPVARIANT_TO_STRING (*value).UTF8Characters,
+                      NPVARIANT_TO_STRING (*value).UTF8Length);
+    mode = a2d_durability_from_string (name);
+    g_free (name);
+
+    if (mode == A2D_DURABILITY_INVALID)
+        return false;
+
+    g_atomic_int_set (&durability, mode);
+
+    return true;
+}
+
+/*
+ * get_system_locales_only:
+ */
+static bool
+get_system_locales_only (NPObject* obj, NPVariant* result)
+{
+    BOOLEAN_TO_NPVARIANT (g_atomic_int_get (&system_locales_only), *result);
+
+    return true;
+}
+
+/*
+ * set_system_locales_only:
+ *
+ * Limits localizations of the following generated apps to the locales
+ * configured on the system, other locales are not read at all.
+ */
+static bool
+set_system_locales_only (NPObject* obj, const NPVariant* value)
+{
+    if (!NPVARIANT_IS_BOOLEAN (*value))
+        return false;
+
+    g_atomic_int_set (&system_locales_only, NPVARIANT_TO_BOOLEAN (*value));
+
+    return true;
+}
+
+/*
+ * get_threads:
+ *
+ * Returns number of threads running operations of one batch, 0 means the
+ * number of processors.
+ */
+static bool
+get_threads (NPObject* obj, NPVariant* result)
+{
+    INT32_TO_NPVARIANT (g_atomic_int_get (&threads), *result);
+
+    return true;
+}
+
+/*
+ * set_threads:
+ *
+ * Sets number of threads for the following batches, with 1 the operations
+ * run one after another.
+ */
+static bool
+set_threads (NPObject* obj, const NPVariant* value)
+{
+    gint n_threads;
+
+    if (NPVARIANT_IS_INT32 (*value))
+        n_threads = NPVARIANT_TO_INT32 (*value);
+    else if (NPVARIANT_IS_DOUBLE (*value))
+        n_threads = NPVARIANT_TO_DOUBLE (*value);
+    else
+        return false;
+
+    if (n_threads < 0 || n_threads > MAX_POOL_THREADS)
+        return false;
+
+    g_atomic_int_set (&threads, n_threads);
+
+    return true;
+}
+
+/*
+ * get_cooperative:
+ */
+static bool
+get_cooperative (NPObject* obj, NPVariant* result)
+{
+    BOOLEAN_TO_NPVARIANT (g_atomic_int_get (&cooperative), *result);
+
+    return true;
+}
+
+/*
+ * set_cooperative:
+ *
+ * Processes the following asynchronous operations and syncs in slices of
+ * SLICE_BUDGET milliseconds on the plugin thread, no thread is started for
+ * them. It's used also when threads can't be created.
+ */
+static bool
+set_cooperative (NPObject* obj, const NPVariant* value)
+{
+    if (!NPVARIANT_IS_BOOLEAN (*value))
         return false;
+
+    g_atomic_int_set (&cooperative, NPVARIANT_TO_BOOLEAN (*value));
+
+    return true;
+}
+
+/*
+ * Scriptable methods and properties, identifiers of their names are
+ * resolved once in a2d_plugin_set_np_netscape_functions.
+ */
+typedef bool (*A2DMethodFunc) (NPObject* obj, const NPVariant* args,
+                               uint32_t arg_count, NPVariant* result);
+typedef bool (*A2DPropertyFunc) (NPObject* obj, NPVariant* result);
+typedef bool (*A2DPropertySetFunc) (NPObject* obj, const NPVariant* value);
+
+typedef struct
+{
+    const NPUTF8	*name;
+    A2DMethodFunc	 invoke;
+    NPIdentifier	 identifier;
+} A2DMethod;
+
+typedef struct
+{
+    const NPUTF8	*name;
+    A2DPropertyFunc	 get;
+    A2DPropertySetFunc	 set;
+    NPIdentifier	 identifier;
+} A2DProperty;
+
+static A2DMethod methods[] = {
+    { METHOD_ADD, invoke_add, NULL },
+    { METHOD_REMOVE, invoke_remove, NULL },
+    { METHOD_ENABLE, invoke_enable, NULL },
+    { METHOD_DISABLE, invoke_disable, NULL },
+    { METHOD_APPLY_BATCH, invoke_apply_batch, NULL },
+    { METHOD_SYNC, invoke_sync, NULL }
+};
+
+static A2DProperty properties[] = {
+    { PROPERTY_QUEUE_DEPTH, get_queue_depth, NULL, NULL },
+    { PROPERTY_STATS, get_stats, NULL, NULL },
+    { PROPERTY_DURABILITY, get_durability, set_durability, NULL },
+    { PROPERTY_SYSTEM_LOCALES_ONLY, get_system_locales_only, set_system_locales_only, NULL },
+    { PROPERTY_THREADS, get_threads, set_threads, NULL },
+    { PROPERTY_COOPERATIVE, get_cooperative, set_cooperative, NULL }
+};
+
+/*
+ * find_method:
+ */
+static const A2DMethod *
+find_method (NPIdentifier identifier)
+{
+    guint ii;
+
+    for (ii = 0; ii < G_N_ELEMENTS (methods); ii++) {
+        if (methods[ii].identifier == identifier)
+            return &methods[ii];
+    }
+
+    return NULL;
+}
+
+/*
+ * find_property:
+ */
+static const A2DProperty *
+find_property (NPIdentifier identifier)
+{
+    guint ii;
+
+    for (ii = 0; ii < G_N_ELEMENTS (properties); ii++) {
+        if (properties[ii].identifier == identifier)
+            return &properties[ii];
     }
+
+    return NULL;
+}
+
+/*
+ * a2d_plugin_set_no_netscape_functions:
+ *
+ * Saves browser's functions and resolves identifiers we dispatch on.
+ */
+void
+a2d_plugin_set_np_netscape_functions (NPNetscapeFuncs *npnfunctions)
+{
+    guint ii;
+
+    if (npnfuncs == npnfunctions)
+        return;
+
+    npnfuncs = npnfunctions;
+
+    for (ii = 0; ii < G_N_ELEMENTS (methods); ii++)
+        methods[ii].identifier = npnfuncs->getstringidentifier (methods[ii].name);
+
+    for (ii = 0; ii < G_N_ELEMENTS (properties); ii++)
+        properties[ii].identifier = npnfuncs->getstringidentifier (properties[ii].name);
+
+    npnfuncs->getstringidentifiers (descriptor_members, DESCRIPTOR_LAST, descriptor_identifiers);
+    length_identifier = npnfuncs->getstringidentifier ("length");
+}
+
+bool
+np_class_has_method(NPObject* obj, NPIdentifier method_name)
+{
+    return find_method (method_name) != NULL;
+}
+
+bool
+np_class_invoke_default(NPObject* obj, const NPVariant* args,
+                            uint32_t argCount, NPVariant* result)
+{
     return true;
 }
 
+bool
+np_class_invoke(NPObject* obj, NPIdentifier method_name, const NPVariant* args,
+                uint32_t arg_count, NPVariant* result)
+{
+    const A2DMethod *method;
+    gint64 dispatch_start = a2d_stats_get_time_ns ();
+
+    method = find_method (method_name);
+
+    a2d_stats_add (A2D_STAT_DISPATCH_CALLS, 1);
+    a2d_stats_add (A2D_STAT_DISPATCH_NSEC, a2d_stats_get_time_ns () - dispatch_start);
+
+    if (!method) {
+        npnfuncs->setexception(obj, "Unknown method");
+        return false;
+    }
+
+    ensure_initialized ();
+
+    return method->invoke (obj, args, arg_count, result);
+}
+
 bool
 np_class_has_property(NPObject* obj, NPIdentifier property_name)
 {
-    return false;
+    return find_property (property_name) != NULL;
 }
 
 bool
 np_class_get_property(NPObject* obj, NPIdentifier property_name, NPVariant* result)
 {
-    return false;
+    const A2DProperty *property = find_property (property_name);
+
+    if (!property)
+        return false;
+
+    return property->get (obj, result);
+}
+
+bool
+np_class_set_property(NPObject* obj, NPIdentifier property_name, const NPVariant* value)
+{
+    const A2DProperty *property = find_property (property_name);
+
+    if (!property || !property->set)
+        return false;
+
+    return property->set (obj, value);
 }
 
 NPObject *
@@ -882,6 +3748,70 @@ a2d_plugin_get_scriptable_object (A2DPlugin *plugin)
     return plugin->priv->pScriptableObject;
 }
 
+/*
+ * a2d_plugin_shutdown:
+ *
+ * Releases state shared by all plugin instances.
+ */
+void
+a2d_plugin_shutdown (void)
+{
+    if (prewarm_thread) {
+        g_thread_join (prewarm_thread);
+        prewarm_thread = NULL;
+    }
+
+    g_mutex_lock (&init_mutex);
+    init_state = INIT_NONE;
+    g_mutex_unlock (&init_mutex);
+
+    a2d_pool_free (pool);
+    pool = NULL;
+    a2d_index_close (app_index);
+    app_index = NULL;
+    a2d_dir_index_free (applications_index);
+    applications_index = NULL;
+    a2d_extension_resolver_free (extension_resolver);
+    extension_resolver = NULL;
+    a2d_icon_cache_free (icon_cache);
+    icon_cache = NULL;
+    a2d_locale_catalog_free (locale_catalog);
+    locale_catalog = NULL;
+    a2d_paths_free (paths);
+    paths = NULL;
+    g_free (app_prefix);
+    app_prefix = NULL;
+    g_free (executable);
+    executable = NULL;
+}
+
+/*
+ * a2d_plugin_prewarm:
+ *
+ * Called when a plugin instance is created. The first call starts the
+ * initialization of the shared state in the background, unless prewarm is
+ * disabled, then it's done on the first invoke.
+ */
+void
+a2d_plugin_prewarm (gboolean enabled)
+{
+    g_mutex_lock (&init_mutex);
+
+    if (!load_time)
+        load_time = a2d_stats_get_time_ns ();
+
+    if (enabled && init_state == INIT_NONE) {
+        prewarm_thread = g_thread_try_new ("a2d-prewarm", prewarm_thread_func, NULL, NULL);
+
+        if (prewarm_thread) {
+            init_state = INIT_RUNNING;
+            a2d_stats_add (A2D_STAT_PREWARMS, 1);
+        }
+    }
+
+    g_mutex_unlock (&init_mutex);
+}
+
 /**
  * a2d_plugin_finalize:
  **/
@@ -891,7 +3821,13 @@ a2d_plugin_finalize (GObject *object)
     A2DPlugin *plugin;
     g_return_if_fail (A2D_IS_PLUGIN (object));
     plugin = A2D_PLUGIN (object);
-    g_free (app_prefix);
+
+    /* No new results will come after the worker is stopped and the ones
+     * already scheduled will be dropped */
+    a2d_worker_free (plugin->priv->worker);
+    plugin->priv->async_target->instance = NULL;
+    slicer_free (plugin->priv->slicer);
+    async_target_unref (plugin->priv->async_target);
 
     if (plugin->priv->pScriptableObject)
         npnfuncs->releaseobject ((NPObject *) plugin->priv->pScriptableObject);
@@ -920,6 +3856,10 @@ a2d_plugin_init (A2DPlugin *plugin)
     plugin->priv = A2D_PLUGIN_GET_PRIVATE (plugin);
     plugin->priv->pNPInstance = 0;
     plugin->priv->pScriptableObject = NULL;
+    plugin->priv->worker = NULL;
+    plugin->priv->slicer = NULL;
+    plugin->priv->async_target = g_new0 (A2DAsyncTarget, 1);
+    plugin->priv->async_target->ref_count = 1;
 }
 
 /**
@@ -927,10 +3867,12 @@ a2d_plugin_init (A2DPlugin *plugin)
  * Return value: A new plugin_install class instance.
  **/
 A2DPlugin *
-a2d_plugin_new (void)
+a2d_plugin_new (NPP instance)
 {
     A2DPlugin *plugin;
     plugin = g_object_new (A2D_TYPE_PLUGIN, NULL);
+    plugin->priv->pNPInstance = instance;
+    plugin->priv->async_target->instance = instance;
     return A2D_PLUGIN (plugin);
 }
 
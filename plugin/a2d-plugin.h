@@ -51,9 +51,11 @@ typedef struct
 } A2DPluginClass;
 
 GType		a2d_plugin_get_type			(void);
-A2DPlugin *	a2d_plugin_new				(void);
+A2DPlugin *	a2d_plugin_new				(NPP instance);
 void		a2d_plugin_set_np_netscape_functions	(NPNetscapeFuncs *npnfunctions);
 NPObject *	a2d_plugin_get_scriptable_object	(A2DPlugin *plugin);
+void		a2d_plugin_shutdown			(void);
+void		a2d_plugin_prewarm			(gboolean enabled);
 
 /*
  * NPClass methods
@@ -77,6 +79,9 @@ bool		np_class_has_property			(NPObject* obj,
 bool		np_class_get_property			(NPObject* obj,
 							 NPIdentifier property_Name,
 							 NPVariant* result);
+bool		np_class_set_property			(NPObject* obj,
+							 NPIdentifier property_name,
+							 const NPVariant* value);
 G_END_DECLS
 
 #endif /* __A2D_PLUGIN_H */
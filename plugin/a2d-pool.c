@@ -0,0 +1,369 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <glib.h>
+
+#include "a2d-pool.h"
+#include "a2d-stats.h"
+
+typedef struct
+{
+    /* tasks with the same key run in order of pushing, NULL for none */
+    gchar		*key;
+    gpointer		 data;
+} A2DPoolTask;
+
+typedef struct
+{
+    A2DPool		*pool;
+    guint		 index;
+    GThread		*thread;
+    GMutex		 mutex;
+    /* owner takes tasks from the head, other threads steal from the tail */
+    GQueue		 deque;
+} A2DPoolWorker;
+
+/*
+ * Pool of threads with a queue per thread. Threads run tasks from their own
+ * queue and when it's empty they steal from the queues of the others, so
+ * slow tasks don't hold up the tasks queued after them.
+ */
+struct A2DPool
+{
+    A2DPoolWorker	*workers;
+    guint		 n_threads;
+    A2DPoolFunc		 func;
+    gpointer		 user_data;
+    /* tasks in the queues */
+    gint		 queued;
+    GMutex		 mutex;
+    GCond		 work_cond;
+    GCond		 done_cond;
+    /* following members are protected by the mutex */
+    guint		 next_worker;
+    guint		 outstanding;
+    GHashTable		*keys;		/* key of running task -> GQueue of waiting tasks */
+    gboolean		 stopping;
+};
+
+/* Worker running in the current thread */
+static GPrivate current_worker;
+
+static void
+task_free (A2DPoolTask *task)
+{
+    g_free (task->key);
+    g_free (task);
+}
+
+static void
+waiting_free (gpointer data)
+{
+    g_queue_free_full (data, (GDestroyNotify) task_free);
+}
+
+/*
+ * schedule:
+ *
+ * Queues task to be run. Next step of task stays at the head of the queue of
+ * the thread which ran the previous one, other tasks are spread over the
+ * threads. Called with the pool's mutex held.
+ */
+static void
+schedule (A2DPool *pool, A2DPoolTask *task, gboolean next_step)
+{
+    A2DPoolWorker *worker = g_private_get (&current_worker);
+
+    if (!next_step || !worker || worker->pool != pool) {
+        worker = &pool->workers[pool->next_worker];
+        pool->next_worker = (pool->next_worker + 1) % pool->n_threads;
+        next_step = FALSE;
+    }
+
+    g_mutex_lock (&worker->mutex);
+
+    if (next_step)
+        g_queue_push_head (&worker->deque, task);
+    else
+        g_queue_push_tail (&worker->deque, task);
+
+    g_mutex_unlock (&worker->mutex);
+
+    g_atomic_int_inc (&pool->queued);
+    g_cond_signal (&pool->work_cond);
+}
+
+/*
+ * take_task:
+ *
+ * Takes task from the thread's own queue, or steals one from the others.
+ */
+static A2DPoolTask *
+take_task (A2DPoolWorker *worker)
+{
+    A2DPool *pool = worker->pool;
+    A2DPoolTask *task;
+    guint ii;
+
+    g_mutex_lock (&worker->mutex);
+    task = g_queue_pop_head (&worker->deque);
+    g_mutex_unlock (&worker->mutex);
+
+    for (ii = 1; !task && ii < pool->n_threads; ii++) {
+        A2DPoolWorker *victim = &pool->workers[(worker->index + ii) % pool->n_threads];
+
+        g_mutex_lock (&victim->mutex);
+        task = g_queue_pop_tail (&victim->deque);
+        g_mutex_unlock (&victim->mutex);
+
+        if (task)
+            a2d_stats_add (A2D_STAT_POOL_STEALS, 1);
+    }
+
+    if (task)
+        g_atomic_int_add (&pool->queued, -1);
+
+    return task;
+}
+
+/*
+ * run_task:
+ *
+ * Runs one step of the task. When the task is done, the next task waiting
+ * for its key is queued.
+ */
+static void
+run_task (A2DPool *pool, A2DPoolTask *task)
+{
+    gboolean next_step = pool->func (task->data, pool->user_data);
+
+    a2d_stats_add (A2D_STAT_POOL_TASKS, 1);
+
+    g_mutex_lock (&pool->mutex);
+
+    if (next_step) {
+        schedule (pool, task, TRUE);
+        g_mutex_unlock (&pool->mutex);
+
+        return;
+    }
+
+    if (task->key) {
+        A2DPoolTask *waiting = g_queue_pop_head (g_hash_table_lookup (pool->keys, task->key));
+
+        if (waiting)
+            schedule (pool, waiting, FALSE);
+        else
+            g_hash_table_remove (pool->keys, task->key);
+    }
+
+    if (--pool->outstanding == 0)
+        g_cond_broadcast (&pool->done_cond);
+
+    g_mutex_unlock (&pool->mutex);
+
+    task_free (task);
+}
+
+static gpointer
+worker_thread (gpointer data)
+{
+    A2DPoolWorker *worker = data;
+    A2DPool *pool = worker->pool;
+
+    g_private_set (&current_worker, worker);
+
+    g_mutex_lock (&pool->mutex);
+    g_mutex_unlock (&pool->mutex);
+
+    while (TRUE) {
+        A2DPoolTask *task = take_task (worker);
+        gboolean stopping;
+
+        if (task) {
+            run_task (pool, task);
+            continue;
+        }
+
+        g_mutex_lock (&pool->mutex);
+
+        while (!pool->stopping && g_atomic_int_get (&pool->queued) == 0)
+            g_cond_wait (&pool->work_cond, &pool->mutex);
+
+        stopping = pool->stopping;
+
+        g_mutex_unlock (&pool->mutex);
+
+        if (stopping)
+            break;
+    }
+
+    return NULL;
+}
+
+/*
+ * a2d_pool_new:
+ *
+ * Starts pool of n_threads threads running func on pushed tasks. When not all
+ * threads can be created, the pool has less of them. Returns NULL when no
+ * thread was created.
+ */
+A2DPool *
+a2d_pool_new (guint n_threads, A2DPoolFunc func, gpointer user_data)
+{
+    A2DPool *pool = g_new0 (A2DPool, 1);
+    guint ii;
+
+    pool->workers = g_new0 (A2DPoolWorker, MAX (n_threads, 1));
+    pool->func = func;
+    pool->user_data = user_data;
+    g_mutex_init (&pool->mutex);
+    g_cond_init (&pool->work_cond);
+    g_cond_init (&pool->done_cond);
+    pool->keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, waiting_free);
+
+    for (ii = 0; ii < n_threads; ii++) {
+        A2DPoolWorker *worker = &pool->workers[ii];
+
+        worker->pool = pool;
+        worker->index = ii;
+        g_mutex_init (&worker->mutex);
+        g_queue_init (&worker->deque);
+    }
+
+    /* Threads wait for the mutex until the number of them is known */
+    g_mutex_lock (&pool->mutex);
+
+    for (ii = 0; ii < n_threads; ii++) {
+        pool->workers[ii].thread = g_thread_try_new (
+            "a2d-pool", worker_thread, &pool->workers[ii], NULL);
+
+        if (!pool->workers[ii].thread)
+            break;
+    }
+
+    pool->n_threads = ii;
+
+    for (; ii < n_threads; ii++)
+        g_mutex_clear (&pool->workers[ii].mutex);
+
+    g_mutex_unlock (&pool->mutex);
+
+    if (!pool->n_threads) {
+        a2d_pool_free (pool);
+
+        return NULL;
+    }
+
+    return pool;
+}
+
+/*
+ * a2d_pool_free:
+ *
+ * Waits for the pushed tasks and stops the threads.
+ */
+void
+a2d_pool_free (A2DPool *pool)
+{
+    guint ii;
+
+    if (!pool)
+        return;
+
+    a2d_pool_wait (pool);
+
+    g_mutex_lock (&pool->mutex);
+    pool->stopping = TRUE;
+    g_cond_broadcast (&pool->work_cond);
+    g_mutex_unlock (&pool->mutex);
+
+    for (ii = 0; ii < pool->n_threads; ii++)
+        g_thread_join (pool->workers[ii].thread);
+
+    for (ii = 0; ii < pool->n_threads; ii++)
+        g_mutex_clear (&pool->workers[ii].mutex);
+
+    g_hash_table_destroy (pool->keys);
+    g_mutex_clear (&pool->mutex);
+    g_cond_clear (&pool->work_cond);
+    g_cond_clear (&pool->done_cond);
+    g_free (pool->workers);
+    g_free (pool);
+}
+
+/*
+ * a2d_pool_get_n_threads:
+ */
+guint
+a2d_pool_get_n_threads (A2DPool *pool)
+{
+    return pool->n_threads;
+}
+
+/*
+ * a2d_pool_push:
+ *
+ * Queues task. Tasks with the same key (e.g. operations of one app) are run
+ * one after another in order of pushing, the others run in parallel. Key can
+ * be NULL.
+ */
+void
+a2d_pool_push (A2DPool *pool, const gchar *key, gpointer data)
+{
+    A2DPoolTask *task = g_new0 (A2DPoolTask, 1);
+
+    task->key = g_strdup (key);
+    task->data = data;
+
+    g_mutex_lock (&pool->mutex);
+
+    pool->outstanding++;
+
+    if (key && g_hash_table_contains (pool->keys, key)) {
+        g_queue_push_tail (g_hash_table_lookup (pool->keys, key), task);
+    } else {
+        if (key)
+            g_hash_table_insert (pool->keys, g_strdup (key), g_queue_new ());
+
+        schedule (pool, task, FALSE);
+    }
+
+    g_mutex_unlock (&pool->mutex);
+}
+
+/*
+ * a2d_pool_wait:
+ *
+ * Waits until all pushed tasks are done.
+ */
+void
+a2d_pool_wait (A2DPool *pool)
+{
+    g_mutex_lock (&pool->mutex);
+
+    while (pool->outstanding > 0)
+        g_cond_wait (&pool->done_cond, &pool->mutex);
+
+    g_mutex_unlock (&pool->mutex);
+}
@@ -0,0 +1,50 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#ifndef __A2D_POOL_H
+#define __A2D_POOL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct A2DPool A2DPool;
+
+/* Runs one step of the task in a pool thread. Returns TRUE when the task has
+ * another step, it's then run again before other tasks with the same key. */
+typedef gboolean	(*A2DPoolFunc)			(gpointer task,
+							 gpointer user_data);
+
+A2DPool *	a2d_pool_new				(guint n_threads,
+							 A2DPoolFunc func,
+							 gpointer user_data);
+void		a2d_pool_free				(A2DPool *pool);
+guint		a2d_pool_get_n_threads			(A2DPool *pool);
+void		a2d_pool_push				(A2DPool *pool,
+							 const gchar *key,
+							 gpointer task);
+void		a2d_pool_wait				(A2DPool *pool);
+
+G_END_DECLS
+
+#endif /* __A2D_POOL_H */
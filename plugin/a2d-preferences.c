@@ -0,0 +1,261 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "a2d-json.h"
+#include "a2d-preferences.h"
+#include "a2d-stats.h"
+
+/*
+ * Values read from the Preferences file of the browser's profile. Only the
+ * last launch times of extensions are kept, in microseconds as the browser
+ * stores them.
+ */
+struct A2DPreferences
+{
+    GHashTable		*launch_times;	/* app id -> gint64 */
+};
+
+/* State of the streaming scan of Preferences */
+typedef struct {
+    A2DPreferences	*preferences;
+    GString		*member_name;
+    const gchar		*app_id;
+} A2DPreferencesReader;
+
+/*
+ * store_launch_time:
+ */
+static void
+store_launch_time (A2DPreferences *preferences, const gchar *app_id, const gchar *value)
+{
+    gint64 *launch_time = g_new (gint64, 1);
+
+    *launch_time = g_ascii_strtoll (value, NULL, 10);
+
+    g_hash_table_insert (preferences->launch_times, g_strdup (app_id), launch_time);
+}
+
+/*
+ * read_extension_member:
+ */
+static gboolean
+read_extension_member (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    A2DPreferencesReader *reader = user_data;
+    GString *value;
+
+    if (strcmp (name->str, "last_launch_time") != 0 || a2d_json_peek (scanner) != '"')
+        return a2d_json_skip_value (scanner);
+
+    value = g_string_new (NULL);
+
+    if (!a2d_json_read_string (scanner, value)) {
+        g_string_free (value, TRUE);
+
+        return FALSE;
+    }
+
+    store_launch_time (reader->preferences, reader->app_id, value->str);
+    g_string_free (value, TRUE);
+
+    return TRUE;
+}
+
+/*
+ * read_settings_member:
+ *
+ * Members of the extensions' settings are named by their ids.
+ */
+static gboolean
+read_settings_member (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    A2DPreferencesReader *reader = user_data;
+    gchar *app_id;
+    gboolean ret_val;
+
+    if (a2d_json_peek (scanner) != '{')
+        return a2d_json_skip_value (scanner);
+
+    /* The member name is reused for the nested members */
+    app_id = g_strdup (name->str);
+    reader->app_id = app_id;
+
+    ret_val = a2d_json_read_object (scanner, reader->member_name,
+                                    read_extension_member, reader);
+
+    reader->app_id = NULL;
+    g_free (app_id);
+
+    return ret_val;
+}
+
+/*
+ * read_extensions_member:
+ */
+static gboolean
+read_extensions_member (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    A2DPreferencesReader *reader = user_data;
+
+    if (strcmp (name->str, "settings") != 0 || a2d_json_peek (scanner) != '{')
+        return a2d_json_skip_value (scanner);
+
+    return a2d_json_read_object (scanner, reader->member_name, read_settings_member, reader);
+}
+
+/*
+ * read_preferences_member:
+ *
+ * Descends only into the extensions' settings, the rest of the preferences is
+ * skipped without being decoded.
+ */
+static gboolean
+read_preferences_member (A2DJsonScanner *scanner, GString *name, gpointer user_data)
+{
+    A2DPreferencesReader *reader = user_data;
+
+    if (strcmp (name->str, "extensions") != 0 || a2d_json_peek (scanner) != '{')
+        return a2d_json_skip_value (scanner);
+
+    return a2d_json_read_object (scanner, reader->member_name, read_extensions_member, reader);
+}
+
+/*
+ * parse_json_glib:
+ *
+ * Reads the launch times through json-glib, used when the streaming reader
+ * doesn't understand the file.
+ */
+static gboolean
+parse_json_glib (const gchar *contents, gsize length, A2DPreferences *preferences)
+{
+    JsonParser *parser = json_parser_new ();
+    JsonReader *json_reader;
+    gchar **members = NULL;
+    gint ii;
+
+    if (!json_parser_load_from_data (parser, contents, length, NULL)) {
+        g_object_unref (parser);
+
+        return FALSE;
+    }
+
+    json_reader = json_reader_new (json_parser_get_root (parser));
+
+    if (json_reader_read_member (json_reader, "extensions") &&
+        json_reader_read_member (json_reader, "settings"))
+        members = json_reader_list_members (json_reader);
+
+    for (ii = 0; members && members[ii]; ii++) {
+        if (json_reader_read_member (json_reader, members[ii]) &&
+            json_reader_read_member (json_reader, "last_launch_time") &&
+            json_reader_is_value (json_reader) &&
+            json_reader_get_string_value (json_reader))
+            store_launch_time (preferences, members[ii],
+                               json_reader_get_string_value (json_reader));
+
+        json_reader_end_member (json_reader);
+        json_reader_end_member (json_reader);
+    }
+
+    g_strfreev (members);
+    g_object_unref (json_reader);
+    g_object_unref (parser);
+
+    return TRUE;
+}
+
+/*
+ * a2d_preferences_load:
+ *
+ * Reads the Preferences file. Returns NULL when it can't be read.
+ */
+A2DPreferences *
+a2d_preferences_load (const gchar *filename)
+{
+    A2DPreferences *preferences;
+    A2DPreferencesReader reader;
+    GMappedFile *mapped_file;
+    A2DJsonScanner scanner;
+    const gchar *contents;
+    gsize length;
+
+    mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+    if (!mapped_file)
+        return NULL;
+
+    contents = g_mapped_file_get_contents (mapped_file);
+    length = g_mapped_file_get_length (mapped_file);
+
+    preferences = g_new0 (A2DPreferences, 1);
+    preferences->launch_times = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    memset (&reader, 0, sizeof (A2DPreferencesReader));
+    reader.preferences = preferences;
+    reader.member_name = g_string_new (NULL);
+
+    a2d_json_scanner_init (&scanner, contents, length);
+
+    if (!a2d_json_read_object (&scanner, reader.member_name, read_preferences_member, &reader) ||
+        !a2d_json_is_at_end (&scanner)) {
+        g_hash_table_remove_all (preferences->launch_times);
+
+        parse_json_glib (contents, length, preferences);
+        a2d_stats_add (A2D_STAT_PREFERENCES_FALLBACKS, 1);
+    }
+
+    g_string_free (reader.member_name, TRUE);
+    g_mapped_file_unref (mapped_file);
+
+    return preferences;
+}
+
+/*
+ * a2d_preferences_free:
+ */
+void
+a2d_preferences_free (A2DPreferences *preferences)
+{
+    if (!preferences)
+        return;
+
+    g_hash_table_destroy (preferences->launch_times);
+    g_free (preferences);
+}
+
+/*
+ * a2d_preferences_get_last_launch_time:
+ *
+ * Returns when app was launched last time, 0 when it never was.
+ */
+gint64
+a2d_preferences_get_last_launch_time (A2DPreferences *preferences, const gchar *app_id)
+{
+    gint64 *launch_time = g_hash_table_lookup (preferences->launch_times, app_id);
+
+    return launch_time ? *launch_time : 0;
+}
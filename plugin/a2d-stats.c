@@ -0,0 +1,154 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+#include <time.h>
+
+#include "a2d-stats.h"
+
+/* Names under which the counters are visible in JavaScript */
+static const gchar *stat_names[A2D_STAT_LAST] = {
+    "dispatchCalls",
+    "dispatchNanoseconds",
+    "manifestLoads",
+    "manifestFallbacks",
+    "manifestNanoseconds",
+    "extensionLookups",
+    "extensionScans",
+    "commitFiles",
+    "commitSyncs",
+    "commitNanoseconds",
+    "commitFailures",
+    "iconThemeBumps",
+    "iconDirectoryBumps",
+    "iconCacheScans",
+    "iconCacheWrites",
+    "iconsGenerated",
+    "iconsReused",
+    "iconsRejected",
+    "desktopEntries",
+    "desktopEntryNanoseconds",
+    "enablePatched",
+    "enableUnchanged",
+    "desktopWrites",
+    "desktopWritesSkipped",
+    "appsUnchanged",
+    "localeFilesParsed",
+    "localeFallbacks",
+    "localeCacheHits",
+    "localeNanoseconds",
+    "arenaAllocations",
+    "arenaMaxAllocations",
+    "arenaBlocks",
+    "pathsInterned",
+    "pathCacheHits",
+    "poolTasks",
+    "poolSteals",
+    "parallelOperations",
+    "parallelNanoseconds",
+    "operationsCoalesced",
+    "operationsExecuted",
+    "preferencesFallbacks",
+    "bulkYields",
+    "interactiveAdds",
+    "interactiveAddNanoseconds",
+    "interactiveAddMaxNanoseconds",
+    "syncSuperseded",
+    "prewarms",
+    "initNanoseconds",
+    "initWaits",
+    "initWaitNanoseconds",
+    "firstAddNanoseconds",
+    "slices",
+    "sliceNanoseconds",
+    "sliceMaxNanoseconds"
+};
+
+static gint64 stats[A2D_STAT_LAST];
+
+G_LOCK_DEFINE_STATIC (stats);
+
+/*
+ * a2d_stats_add:
+ *
+ * Adds value to the counter.
+ */
+void
+a2d_stats_add (A2DStat stat, gint64 value)
+{
+    G_LOCK (stats);
+    stats[stat] += value;
+    G_UNLOCK (stats);
+}
+
+/*
+ * a2d_stats_set_max:
+ *
+ * Sets the counter to value if it's greater than the current one.
+ */
+void
+a2d_stats_set_max (A2DStat stat, gint64 value)
+{
+    G_LOCK (stats);
+    stats[stat] = MAX (stats[stat], value);
+    G_UNLOCK (stats);
+}
+
+/*
+ * a2d_stats_get:
+ */
+gint64
+a2d_stats_get (A2DStat stat)
+{
+    gint64 value;
+
+    G_LOCK (stats);
+    value = stats[stat];
+    G_UNLOCK (stats);
+
+    return value;
+}
+
+/*
+ * a2d_stats_get_name:
+ */
+const gchar *
+a2d_stats_get_name (A2DStat stat)
+{
+    return stat_names[stat];
+}
+
+/*
+ * a2d_stats_get_time_ns:
+ *
+ * Returns monotonic time in nanoseconds, g_get_monotonic_time () is too
+ * coarse for measuring the dispatch.
+ */
+gint64
+a2d_stats_get_time_ns (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return (gint64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
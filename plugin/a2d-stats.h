@@ -0,0 +1,99 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __A2D_STATS_H
+#define __A2D_STATS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* When adding new counter don't forget to add its name to stat_names */
+typedef enum {
+	A2D_STAT_DISPATCH_CALLS,
+	A2D_STAT_DISPATCH_NSEC,
+	A2D_STAT_MANIFEST_LOADS,
+	A2D_STAT_MANIFEST_FALLBACKS,
+	A2D_STAT_MANIFEST_NSEC,
+	A2D_STAT_EXTENSION_LOOKUPS,
+	A2D_STAT_EXTENSION_SCANS,
+	A2D_STAT_COMMIT_FILES,
+	A2D_STAT_COMMIT_SYNCS,
+	A2D_STAT_COMMIT_NSEC,
+	A2D_STAT_COMMIT_FAILURES,
+	A2D_STAT_ICON_THEME_BUMPS,
+	A2D_STAT_ICON_DIRECTORY_BUMPS,
+	A2D_STAT_ICON_CACHE_SCANS,
+	A2D_STAT_ICON_CACHE_WRITES,
+	A2D_STAT_ICONS_GENERATED,
+	A2D_STAT_ICONS_REUSED,
+	A2D_STAT_ICONS_REJECTED,
+	A2D_STAT_DESKTOP_ENTRIES,
+	A2D_STAT_DESKTOP_ENTRY_NSEC,
+	A2D_STAT_ENABLE_PATCHED,
+	A2D_STAT_ENABLE_UNCHANGED,
+	A2D_STAT_DESKTOP_WRITES,
+	A2D_STAT_DESKTOP_WRITES_SKIPPED,
+	A2D_STAT_APPS_UNCHANGED,
+	A2D_STAT_LOCALE_FILES_PARSED,
+	A2D_STAT_LOCALE_FALLBACKS,
+	A2D_STAT_LOCALE_CACHE_HITS,
+	A2D_STAT_LOCALE_NSEC,
+	A2D_STAT_ARENA_ALLOCATIONS,
+	A2D_STAT_ARENA_MAX_ALLOCATIONS,
+	A2D_STAT_ARENA_BLOCKS,
+	A2D_STAT_PATHS_INTERNED,
+	A2D_STAT_PATH_CACHE_HITS,
+	A2D_STAT_POOL_TASKS,
+	A2D_STAT_POOL_STEALS,
+	A2D_STAT_PARALLEL_OPERATIONS,
+	A2D_STAT_PARALLEL_NSEC,
+	A2D_STAT_OPERATIONS_COALESCED,
+	A2D_STAT_OPERATIONS_EXECUTED,
+	A2D_STAT_PREFERENCES_FALLBACKS,
+	A2D_STAT_BULK_YIELDS,
+	A2D_STAT_INTERACTIVE_ADDS,
+	A2D_STAT_INTERACTIVE_ADD_NSEC,
+	A2D_STAT_INTERACTIVE_ADD_MAX_NSEC,
+	A2D_STAT_SYNC_SUPERSEDED,
+	A2D_STAT_PREWARMS,
+	A2D_STAT_INIT_NSEC,
+	A2D_STAT_INIT_WAITS,
+	A2D_STAT_INIT_WAIT_NSEC,
+	A2D_STAT_FIRST_ADD_NSEC,
+	A2D_STAT_SLICES,
+	A2D_STAT_SLICE_NSEC,
+	A2D_STAT_SLICE_MAX_NSEC,
+	A2D_STAT_LAST
+} A2DStat;
+
+void		a2d_stats_add				(A2DStat stat,
+							 gint64 value);
+void		a2d_stats_set_max			(A2DStat stat,
+							 gint64 value);
+gint64		a2d_stats_get				(A2DStat stat);
+const gchar *	a2d_stats_get_name			(A2DStat stat);
+gint64		a2d_stats_get_time_ns			(void);
+
+G_END_DECLS
+
+#endif /* __A2D_STATS_H */
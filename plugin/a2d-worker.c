@@ -0,0 +1,316 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <glib.h>
+
+#include "a2d-worker.h"
+
+/* Long running job, e.g. sync of all apps */
+typedef struct
+{
+    A2DWorkerBulkFunc	 func;
+    gpointer		 data;
+    GDestroyNotify	 free_func;
+} A2DWorkerBulkJob;
+
+/*
+ * Worker thread with two queues. Operations in the interactive queue always
+ * run before bulk jobs, and bulk jobs let them run between their items (see
+ * a2d_worker_run_interactive).
+ */
+struct A2DWorker
+{
+    GThread		*thread;
+    GMutex		 mutex;
+    GCond		 cond;
+    GQueue		 queue;
+    GQueue		 bulk;
+    guint		 max_depth;
+    guint		 window;
+    gboolean		 stopping;
+    A2DWorkerFunc	 func;
+    GDestroyNotify	 free_func;
+    gpointer		 user_data;
+};
+
+/*
+ * take_operations:
+ *
+ * Takes all operations from the interactive queue. Called with the mutex
+ * held.
+ */
+static GPtrArray *
+take_operations (A2DWorker *worker)
+{
+    GPtrArray *operations = g_ptr_array_sized_new (g_queue_get_length (&worker->queue));
+
+    while (!g_queue_is_empty (&worker->queue))
+        g_ptr_array_add (operations, g_queue_pop_head (&worker->queue));
+
+    return operations;
+}
+
+/*
+ * worker_thread:
+ *
+ * Waits for operations and hands everything that is queued at once to the
+ * worker function, so operations queued in a burst are processed together.
+ * After the first operation comes, the worker waits for the window to collect
+ * the rest of the burst, unless the queue gets full. Bulk jobs run only when
+ * there are no operations.
+ */
+static gpointer
+worker_thread (gpointer data)
+{
+    A2DWorker *worker = data;
+
+    g_mutex_lock (&worker->mutex);
+
+    while (TRUE) {
+        GPtrArray *operations;
+        A2DWorkerBulkJob *job;
+        gint64 end_time;
+
+        while (!worker->stopping &&
+               g_queue_is_empty (&worker->queue) && g_queue_is_empty (&worker->bulk))
+            g_cond_wait (&worker->cond, &worker->mutex);
+
+        if (worker->stopping)
+            break;
+
+        if (g_queue_is_empty (&worker->queue)) {
+            job = g_queue_pop_head (&worker->bulk);
+
+            g_mutex_unlock (&worker->mutex);
+
+            job->func (job->data, worker->user_data);
+            g_free (job);
+
+            g_mutex_lock (&worker->mutex);
+            continue;
+        }
+
+        end_time = g_get_monotonic_time () + worker->window * G_TIME_SPAN_MILLISECOND;
+
+        while (!worker->stopping &&
+               g_queue_get_length (&worker->queue) < worker->max_depth &&
+               g_cond_wait_until (&worker->cond, &worker->mutex, end_time))
+            ;
+
+        if (worker->stopping)
+            break;
+
+        operations = take_operations (worker);
+
+        g_mutex_unlock (&worker->mutex);
+
+        worker->func (operations, worker->user_data);
+        g_ptr_array_free (operations, TRUE);
+
+        g_mutex_lock (&worker->mutex);
+    }
+
+    g_mutex_unlock (&worker->mutex);
+
+    return NULL;
+}
+
+/*
+ * a2d_worker_new:
+ *
+ * Starts new worker thread with queue holding at most max_depth
+ * operations, operations coming within window milliseconds are processed
+ * together. Returns NULL when the thread can't be created.
+ */
+A2DWorker *
+a2d_worker_new (guint max_depth, guint window, A2DWorkerFunc func,
+                GDestroyNotify free_func, gpointer user_data)
+{
+    A2DWorker *worker = g_new0 (A2DWorker, 1);
+
+    g_mutex_init (&worker->mutex);
+    g_cond_init (&worker->cond);
+    g_queue_init (&worker->queue);
+    g_queue_init (&worker->bulk);
+    worker->max_depth = max_depth;
+    worker->window = window;
+    worker->func = func;
+    worker->free_func = free_func;
+    worker->user_data = user_data;
+
+    worker->thread = g_thread_try_new ("a2d-worker", worker_thread, worker, NULL);
+    if (!worker->thread) {
+        g_mutex_clear (&worker->mutex);
+        g_cond_clear (&worker->cond);
+        g_free (worker);
+
+        return NULL;
+    }
+
+    return worker;
+}
+
+/*
+ * a2d_worker_push:
+ *
+ * Queues operation for the worker thread. Returns the queue depth including
+ * the new operation or -1 when the queue is full. In that case the caller
+ * keeps the ownership of the operation.
+ */
+gint
+a2d_worker_push (A2DWorker *worker, A2DOperation *operation)
+{
+    gint depth = -1;
+
+    g_mutex_lock (&worker->mutex);
+
+    if (g_queue_get_length (&worker->queue) < worker->max_depth) {
+        g_queue_push_tail (&worker->queue, operation);
+        depth = g_queue_get_length (&worker->queue);
+        g_cond_signal (&worker->cond);
+    }
+
+    g_mutex_unlock (&worker->mutex);
+
+    return depth;
+}
+
+/*
+ * a2d_worker_push_bulk:
+ *
+ * Queues bulk job for the worker thread. Jobs run one after another when
+ * there are no queued operations. The job is freed with free_func when the
+ * worker is stopped before running it.
+ */
+void
+a2d_worker_push_bulk (A2DWorker *worker, A2DWorkerBulkFunc func,
+                      gpointer data, GDestroyNotify free_func)
+{
+    A2DWorkerBulkJob *job = g_new0 (A2DWorkerBulkJob, 1);
+
+    job->func = func;
+    job->data = data;
+    job->free_func = free_func;
+
+    g_mutex_lock (&worker->mutex);
+    g_queue_push_tail (&worker->bulk, job);
+    g_cond_signal (&worker->cond);
+    g_mutex_unlock (&worker->mutex);
+}
+
+/*
+ * a2d_worker_run_interactive:
+ *
+ * Runs operations waiting in the queue, bulk job calls it between its items
+ * from the worker thread. Returns FALSE when there were none.
+ */
+gboolean
+a2d_worker_run_interactive (A2DWorker *worker)
+{
+    GPtrArray *operations;
+
+    g_mutex_lock (&worker->mutex);
+
+    if (g_queue_is_empty (&worker->queue)) {
+        g_mutex_unlock (&worker->mutex);
+
+        return FALSE;
+    }
+
+    operations = take_operations (worker);
+
+    g_mutex_unlock (&worker->mutex);
+
+    worker->func (operations, worker->user_data);
+    g_ptr_array_free (operations, TRUE);
+
+    return TRUE;
+}
+
+/*
+ * a2d_worker_is_stopping:
+ *
+ * Bulk jobs check it between their items, so the worker can be stopped
+ * without waiting for all of them.
+ */
+gboolean
+a2d_worker_is_stopping (A2DWorker *worker)
+{
+    gboolean stopping;
+
+    g_mutex_lock (&worker->mutex);
+    stopping = worker->stopping;
+    g_mutex_unlock (&worker->mutex);
+
+    return stopping;
+}
+
+/*
+ * a2d_worker_get_depth:
+ *
+ * Returns number of operations waiting in the queue.
+ */
+guint
+a2d_worker_get_depth (A2DWorker *worker)
+{
+    guint depth;
+
+    g_mutex_lock (&worker->mutex);
+    depth = g_queue_get_length (&worker->queue);
+    g_mutex_unlock (&worker->mutex);
+
+    return depth;
+}
+
+/*
+ * a2d_worker_free:
+ *
+ * Waits for the operations being processed, stops the worker thread and
+ * drops the operations that are still queued.
+ */
+void
+a2d_worker_free (A2DWorker *worker)
+{
+    if (!worker)
+        return;
+
+    g_mutex_lock (&worker->mutex);
+    worker->stopping = TRUE;
+    g_cond_signal (&worker->cond);
+    g_mutex_unlock (&worker->mutex);
+
+    g_thread_join (worker->thread);
+
+    while (!g_queue_is_empty (&worker->queue))
+        worker->free_func (g_queue_pop_head (&worker->queue));
+
+    while (!g_queue_is_empty (&worker->bulk)) {
+        A2DWorkerBulkJob *job = g_queue_pop_head (&worker->bulk);
+
+        job->free_func (job->data);
+        g_free (job);
+    }
+
+    g_mutex_clear (&worker->mutex);
+    g_cond_clear (&worker->cond);
+    g_free (worker);
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __A2D_WORKER_H
+#define __A2D_WORKER_H
+
+#include <glib.h>
+
+#include "a2d-operation.h"
+
+G_BEGIN_DECLS
+
+typedef struct A2DWorker A2DWorker;
+
+/* Called in the worker thread with all operations that were waiting in the
+ * queue. Function takes the ownership of operations. */
+typedef void	(*A2DWorkerFunc)			(GPtrArray *operations,
+							 gpointer user_data);
+
+/* Called in the worker thread with data of bulk job, user_data is the one of
+ * the worker. Function takes the ownership of data. */
+typedef void	(*A2DWorkerBulkFunc)			(gpointer data,
+							 gpointer user_data);
+
+A2DWorker *	a2d_worker_new				(guint max_depth,
+							 guint window,
+							 A2DWorkerFunc func,
+							 GDestroyNotify free_func,
+							 gpointer user_data);
+gint		a2d_worker_push				(A2DWorker *worker,
+							 A2DOperation *operation);
+void		a2d_worker_push_bulk			(A2DWorker *worker,
+							 A2DWorkerBulkFunc func,
+							 gpointer data,
+							 GDestroyNotify free_func);
+gboolean	a2d_worker_run_interactive		(A2DWorker *worker);
+gboolean	a2d_worker_is_stopping			(A2DWorker *worker);
+guint		a2d_worker_get_depth			(A2DWorker *worker);
+void		a2d_worker_free				(A2DWorker *worker);
+
+G_END_DECLS
+
+#endif /* __A2D_WORKER_H */
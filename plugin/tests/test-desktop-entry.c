@@ -0,0 +1,187 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Renders a table of entries through the direct renderer and through
+ * GKeyFile and checks the output is the same byte for byte. The reference
+ * escapes all values as g_key_file_set_string does. Generated files used to
+ * set most of them by g_key_file_set_value, unescaped, so for values with
+ * backslash, tab, newline, carriage return or leading space the output
+ * differs from the one of old versions. */
+
+#include <glib.h>
+#include <string.h>
+
+#include "a2d-desktop-entry.h"
+
+typedef struct {
+    const gchar		*locale;
+    const gchar		*name;
+    const gchar		*comment;
+} TestLocalization;
+
+typedef struct {
+    const gchar		*name;
+    const gchar		*exec;
+    gboolean		 offline_enabled;
+    gboolean		 hidden;
+    const gchar		*app_version;
+    TestLocalization	 localizations[4];
+} TestEntry;
+
+static const TestEntry entries[] = {
+    { "App", "google-chrome --app-id=abc", TRUE, FALSE, "1.0", { { NULL } } },
+    { " Leading space", "chromium --app=http://example.com/?a=1&b=2", FALSE, FALSE, "2", { { NULL } } },
+    { "Two\nlines", "google-chrome --app-id=abc", FALSE, TRUE, "1.0\n1", { { NULL } } },
+    { "Tab\there", "google-chrome --app-id=\tabc", TRUE, TRUE, "\t", { { NULL } } },
+    { "Back\\slash\\", "google-chrome --app=C:\\path", FALSE, FALSE, "\\1", { { NULL } } },
+    { "", "", FALSE, FALSE, "", { { NULL } } },
+    { "Chrome - Mixed \r\n\t\\ ", " exec  ", TRUE, FALSE, " 1 ", { { NULL } } },
+    { "Localized", "google-chrome --app-id=abc", TRUE, FALSE, "3.1",
+      { { "de", "Lokalisiert", "Eine App" },
+        { "pt_BR", " Localizado", NULL },
+        { "zh_CN", NULL, "\u5e94\u7528\n\u7a0b\u5e8f" },
+        { "sr@latin", "", "" } } },
+    { "Ünïcödé ☃", "google-chrome --app-id=abc", FALSE, TRUE, "1",
+      { { "fr", "Appli\\cation\t", " Description " } } }
+};
+
+/*
+ * render_key_file:
+ *
+ * Renders the entry through GKeyFile, it's the reference.
+ */
+static gchar *
+render_key_file (const A2DDesktopEntry *entry, gsize *length)
+{
+    GKeyFile *key_file = g_key_file_new ();
+    gchar *data;
+    guint ii;
+
+    g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           G_KEY_FILE_DESKTOP_KEY_TYPE,
+                           G_KEY_FILE_DESKTOP_TYPE_APPLICATION);
+    g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           G_KEY_FILE_DESKTOP_KEY_NAME, entry->name);
+    g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           G_KEY_FILE_DESKTOP_KEY_EXEC, entry->exec);
+    g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           G_KEY_FILE_DESKTOP_KEY_STARTUP_WM_CLASS,
+                           entry->startup_wm_class);
+    g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           G_KEY_FILE_DESKTOP_KEY_CATEGORIES, "NETWORK");
+    g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           G_KEY_FILE_DESKTOP_KEY_ICON, entry->icon);
+    g_key_file_set_boolean (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                            G_KEY_FILE_DESKTOP_KEY_TERMINAL, FALSE);
+    g_key_file_set_boolean (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                            "X-Offline-Enabled", entry->offline_enabled);
+    g_key_file_set_boolean (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                            G_KEY_FILE_DESKTOP_KEY_HIDDEN, entry->hidden);
+    g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           "X-App-Version", entry->app_version);
+
+    for (ii = 0; entry->localizations && ii < entry->localizations->len; ii++) {
+        A2DLocalization *localization = g_ptr_array_index (entry->localizations, ii);
+
+        if (localization->name)
+            g_key_file_set_locale_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                                          G_KEY_FILE_DESKTOP_KEY_NAME,
+                                          localization->locale, localization->name);
+        if (localization->comment)
+            g_key_file_set_locale_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                                          G_KEY_FILE_DESKTOP_KEY_COMMENT,
+                                          localization->locale, localization->comment);
+    }
+
+    data = g_key_file_to_data (key_file, length, NULL);
+
+    g_key_file_free (key_file);
+
+    return data;
+}
+
+/*
+ * check_entry:
+ */
+static gboolean
+check_entry (const TestEntry *test_entry)
+{
+    A2DDesktopEntry entry;
+    GPtrArray *localizations = g_ptr_array_new_with_free_func (g_free);
+    gchar *rendered, *expected;
+    gsize rendered_length, expected_length;
+    gboolean ret_val;
+    guint ii;
+
+    for (ii = 0; ii < G_N_ELEMENTS (test_entry->localizations); ii++) {
+        const TestLocalization *test_localization = &test_entry->localizations[ii];
+        A2DLocalization *localization;
+
+        if (!test_localization->locale)
+            break;
+
+        localization = g_new0 (A2DLocalization, 1);
+        localization->locale = (gchar *) test_localization->locale;
+        localization->name = (gchar *) test_localization->name;
+        localization->comment = (gchar *) test_localization->comment;
+        g_ptr_array_add (localizations, localization);
+    }
+
+    entry.name = test_entry->name;
+    entry.exec = test_entry->exec;
+    entry.startup_wm_class = "crx_abc";
+    entry.icon = "a2d-abc";
+    entry.offline_enabled = test_entry->offline_enabled;
+    entry.hidden = test_entry->hidden;
+    entry.app_version = test_entry->app_version;
+    entry.localizations = localizations->len ? localizations : NULL;
+
+    rendered = a2d_desktop_entry_render (&entry, &rendered_length);
+    expected = render_key_file (&entry, &expected_length);
+
+    ret_val = rendered_length == expected_length &&
+              memcmp (rendered, expected, rendered_length) == 0;
+
+    if (!ret_val)
+        g_printerr ("Entry differs from GKeyFile output:\n%s\nexpected:\n%s\n",
+                    rendered, expected);
+
+    g_free (rendered);
+    g_free (expected);
+    g_ptr_array_free (localizations, TRUE);
+
+    return ret_val;
+}
+
+int
+main (int argc, char *argv[])
+{
+    gboolean success = TRUE;
+    guint ii;
+
+    for (ii = 0; ii < G_N_ELEMENTS (entries); ii++)
+        success = check_entry (&entries[ii]) && success;
+
+    g_print ("%u desktop entries checked\n", ii);
+
+    return success ? 0 : 1;
+}
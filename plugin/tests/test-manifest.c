@@ -0,0 +1,179 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Loads manifests through both the streaming reader and json-glib and checks
+ * they give the same result. Run without arguments it checks built-in
+ * manifests, with arguments it checks all manifest.json files found in the
+ * given directories (e.g. Extensions directory of a browser profile). */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* Readers are static */
+#include "a2d-manifest.c"
+
+static const gchar *manifests[] = {
+    "{ \"name\": \"App\", \"description\": \"Desc\", \"offline_enabled\": true }",
+    "{ \"name\": \"__MSG_appName__\", \"icons\": { \"16\": \"icon_16.png\", \"128\": \"icon_128.png\" } }",
+    "{ \"name\": \"Esc\\\"aped \\\\ \\/ \\n\\t\", \"description\": \"\\u00e9\\u4e2d\" }",
+    "{ \"name\": \"Ünïcödé ☃\", \"offline_enabled\": false }",
+    "{ \"app\": { \"launch\": { \"web_url\": \"http://example.com\" } }, \"name\": \"Nested\","
+    "  \"permissions\": [ \"tabs\", { \"fileSystem\": [ \"write\" ] } ], \"version\": \"1.0\" }",
+    "{ \"icons\": {}, \"name\": \"\", \"description\": \"\" }",
+    "{ \"name\": \"Numbers\", \"manifest_version\": 2, \"minimum\": -1.5e3, \"flag\": null }",
+    "  \n{\n  \"name\" : \"Whitespace\" ,\n  \"icons\" : { \"48\" : \"a b.png\" }\n}\n  ",
+    "{ \"name\": \"Truncated\"",
+    "[ \"not an object\" ]",
+    ""
+};
+
+static gint checked = 0;
+static gint fallbacks = 0;
+static gint64 streaming_nsec = 0;
+static gint64 json_glib_nsec = 0;
+
+/*
+ * manifests_equal:
+ */
+static gboolean
+manifests_equal (const A2DManifest *a, const A2DManifest *b)
+{
+    guint ii;
+
+    if (g_strcmp0 (a->name, b->name) != 0 ||
+        g_strcmp0 (a->description, b->description) != 0 ||
+        !a->offline_enabled != !b->offline_enabled ||
+        a->icons->len != b->icons->len)
+        return FALSE;
+
+    for (ii = 0; ii < a->icons->len; ii++) {
+        const A2DManifestIcon *icon_a = g_ptr_array_index (a->icons, ii);
+        const A2DManifestIcon *icon_b = g_ptr_array_index (b->icons, ii);
+
+        if (g_strcmp0 (icon_a->size, icon_b->size) != 0 ||
+            g_strcmp0 (icon_a->filename, icon_b->filename) != 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * check_manifest:
+ *
+ * Streaming reader may reject the manifest, then json-glib is used for it.
+ * When it accepts it, the result has to be the same as the json-glib one.
+ */
+static gboolean
+check_manifest (const gchar *label, const gchar *contents, gsize length)
+{
+    A2DManifest *streaming, *json_glib;
+    gint64 start;
+    gboolean ret_val = TRUE;
+
+    start = a2d_stats_get_time_ns ();
+    streaming = load_streaming (contents, length);
+    streaming_nsec += a2d_stats_get_time_ns () - start;
+
+    start = a2d_stats_get_time_ns ();
+    json_glib = load_json_glib (contents, length);
+    json_glib_nsec += a2d_stats_get_time_ns () - start;
+
+    checked++;
+
+    if (!streaming) {
+        fallbacks++;
+    } else if (!json_glib) {
+        g_printerr ("%s: accepted only by the streaming reader\n", label);
+        ret_val = FALSE;
+    } else if (!manifests_equal (streaming, json_glib)) {
+        g_printerr ("%s: readers differ\n", label);
+        ret_val = FALSE;
+    }
+
+    a2d_manifest_free (streaming);
+    a2d_manifest_free (json_glib);
+
+    return ret_val;
+}
+
+/*
+ * check_directory:
+ */
+static gboolean
+check_directory (const gchar *directory)
+{
+    GDir *dir = g_dir_open (directory, 0, NULL);
+    const gchar *name;
+    gboolean ret_val = TRUE;
+
+    if (!dir)
+        return TRUE;
+
+    while ((name = g_dir_read_name (dir))) {
+        gchar *path = g_build_filename (directory, name, NULL);
+
+        if (g_file_test (path, G_FILE_TEST_IS_DIR)) {
+            ret_val = check_directory (path) && ret_val;
+        } else if (strcmp (name, "manifest.json") == 0) {
+            gchar *contents;
+            gsize length;
+
+            if (g_file_get_contents (path, &contents, &length, NULL)) {
+                ret_val = check_manifest (path, contents, length) && ret_val;
+                g_free (contents);
+            }
+        }
+
+        g_free (path);
+    }
+
+    g_dir_close (dir);
+
+    return ret_val;
+}
+
+int
+main (int argc, char *argv[])
+{
+    gboolean success = TRUE;
+    gint ii;
+
+    if (argc < 2) {
+        for (ii = 0; ii < (gint) G_N_ELEMENTS (manifests); ii++) {
+            gchar *label = g_strdup_printf ("manifest %d", ii);
+
+            success = check_manifest (label, manifests[ii], strlen (manifests[ii])) && success;
+            g_free (label);
+        }
+    }
+
+    for (ii = 1; ii < argc; ii++)
+        success = check_directory (argv[ii]) && success;
+
+    g_print ("%d manifests, %d rejected by the streaming reader\n", checked, fallbacks);
+    g_print ("streaming %" G_GINT64_FORMAT " ns, json-glib %" G_GINT64_FORMAT " ns\n",
+             streaming_nsec, json_glib_nsec);
+
+    return success ? 0 : 1;
+}
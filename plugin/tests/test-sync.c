@@ -0,0 +1,319 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * Copyright (C) 2013 Tomas Popela <tpopela@redhat.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Checks that operations run by the user while a sync is running aren't
+ * undone by the operations the sync decided on before, e.g. app removed
+ * during the startup sync isn't generated again. Both the worker thread and
+ * the cooperative slices are covered. */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sync internals are static */
+#include "a2d-plugin.c"
+
+#define APP_X "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+#define APP_Y "bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb"
+
+/* Calls scheduled on the plugin thread */
+typedef struct {
+    void		(*func) (void *);
+    void		*data;
+} TestCall;
+
+static GQueue calls = G_QUEUE_INIT;
+static GMutex calls_mutex;
+static A2DSyncJob *completed_sync = NULL;
+static struct _NPP test_instance;
+
+static void
+test_async_call (NPP instance, void (*func) (void *), void *data)
+{
+    TestCall *call = g_new (TestCall, 1);
+
+    call->func = func;
+    call->data = data;
+
+    g_mutex_lock (&calls_mutex);
+    g_queue_push_tail (&calls, call);
+    g_mutex_unlock (&calls_mutex);
+}
+
+/*
+ * run_calls:
+ *
+ * Runs the scheduled calls, completed sync is kept for the checks instead of
+ * being delivered.
+ */
+static void
+run_calls (void)
+{
+    TestCall *call;
+
+    for (;;) {
+        g_mutex_lock (&calls_mutex);
+        call = g_queue_pop_head (&calls);
+        g_mutex_unlock (&calls_mutex);
+
+        if (!call)
+            break;
+
+        if (call->func == complete_sync)
+            completed_sync = call->data;
+        else
+            call->func (call->data);
+
+        g_free (call);
+    }
+}
+
+/*
+ * create_extension:
+ */
+static void
+create_extension (const gchar *app_id)
+{
+    gchar *directory = g_build_filename (g_get_user_config_dir (), "google-chrome", "Default",
+                                         "Extensions", app_id, "1.0_0", NULL);
+    gchar *manifest = g_build_filename (directory, MANIFEST_FILE, NULL);
+
+    g_mkdir_with_parents (directory, 0700);
+    g_file_set_contents (manifest, "{ \"name\": \"Test\" }", -1, NULL);
+
+    g_free (manifest);
+    g_free (directory);
+}
+
+/*
+ * new_operation:
+ */
+static A2DOperation *
+new_operation (A2DOperationType type, const gchar *app_id, const gchar *app_version)
+{
+    A2DOperation *operation = a2d_operation_new (type, app_id);
+
+    operation->app_name = a2d_operation_copy_string (operation, "Test", 4);
+    operation->app_version = a2d_operation_copy_string (operation, app_version,
+                                                        strlen (app_version));
+    operation->app_launch_url = a2d_operation_copy_string (operation, "", 0);
+
+    return operation;
+}
+
+/*
+ * new_sync_job:
+ */
+static A2DSyncJob *
+new_sync_job (const gchar *app_version)
+{
+    A2DSyncJob *job = g_new0 (A2DSyncJob, 1);
+
+    job->operations = g_ptr_array_new_with_free_func ((GDestroyNotify) a2d_operation_free);
+    g_ptr_array_add (job->operations, new_operation (A2D_OPERATION_ADD, APP_X, app_version));
+    g_ptr_array_add (job->operations, new_operation (A2D_OPERATION_ADD, APP_Y, app_version));
+
+    return job;
+}
+
+/*
+ * add_app_now:
+ *
+ * Adds app the way synchronous add does.
+ */
+static gboolean
+add_app_now (const gchar *app_id, const gchar *app_version)
+{
+    A2DOperation *operation = new_operation (A2D_OPERATION_ADD, app_id, app_version);
+    gboolean ret_val = run_single_operation (operation);
+
+    a2d_operation_free (operation);
+
+    return ret_val;
+}
+
+/*
+ * app_exists:
+ */
+static gboolean
+app_exists (const gchar *app_id)
+{
+    A2DArena *arena = a2d_arena_new (ARENA_BLOCK_SIZE);
+    gboolean ret_val = g_file_test (a2d_paths_get_desktop_path (paths, app_id, arena),
+                                    G_FILE_TEST_EXISTS);
+
+    a2d_arena_free (arena);
+
+    return ret_val;
+}
+
+/*
+ * check:
+ */
+static gboolean
+check (gboolean condition, const gchar *message)
+{
+    if (!condition)
+        g_printerr ("FAILED: %s\n", message);
+
+    return condition;
+}
+
+/*
+ * test_worker:
+ *
+ * Remove queued for the worker runs when the sync yields to it, before the
+ * pending update of the app.
+ */
+static gboolean
+test_worker (A2DAsyncTarget *target)
+{
+    A2DWorker *worker;
+    A2DSyncJob *job;
+    gboolean ret_val = TRUE;
+
+    ret_val = check (add_app_now (APP_X, "1") &&
+                     app_exists (APP_X), "worker: app added") && ret_val;
+
+    /* Long window, the operations are left for the sync */
+    worker = a2d_worker_new (WORKER_QUEUE_DEPTH, 60000, process_queued_operations,
+                             free_queued_operation, target);
+    if (!worker)
+        return check (FALSE, "worker: thread started");
+
+    a2d_worker_push (worker, a2d_operation_new (A2D_OPERATION_REMOVE, APP_X));
+
+    job = new_sync_job ("2");
+    job->worker = worker;
+    run_sync (job);
+
+    ret_val = check (!app_exists (APP_X), "worker: removed app isn't generated again") && ret_val;
+    ret_val = check (app_exists (APP_Y), "worker: other app is synced") && ret_val;
+    ret_val = check (job->result.superseded == 1, "worker: update counted as superseded") && ret_val;
+
+    job->worker = NULL;
+    sync_job_free (job);
+    a2d_worker_free (worker);
+    run_calls ();
+
+    return ret_val;
+}
+
+/*
+ * test_slices:
+ *
+ * Remove queued for the slicer after the sync was prepared.
+ */
+static gboolean
+test_slices (A2DAsyncTarget *target)
+{
+    A2DSlicer *slicer;
+    A2DSyncJob *job;
+    A2DBatch batch;
+    gboolean ret_val = TRUE;
+
+    ret_val = check (add_app_now (APP_X, "3") &&
+                     app_exists (APP_X), "slices: app added") && ret_val;
+
+    slicer = slicer_new (target);
+    job = new_sync_job ("4");
+    job->target = async_target_ref (target);
+    g_queue_push_tail (&slicer->syncs, job);
+
+    G_LOCK (running_operations);
+    batch_begin (&batch);
+    sync_job_step (job, &batch);
+    batch_end (&batch);
+    G_UNLOCK (running_operations);
+
+    g_queue_push_tail (&slicer->operations, a2d_operation_new (A2D_OPERATION_REMOVE, APP_X));
+    schedule_slice (slicer);
+    run_calls ();
+
+    ret_val = check (completed_sync == job, "slices: sync completed") && ret_val;
+    ret_val = check (!app_exists (APP_X), "slices: removed app isn't generated again") && ret_val;
+    ret_val = check (app_exists (APP_Y), "slices: other app is synced") && ret_val;
+    ret_val = check (job->result.superseded == 1, "slices: update counted as superseded") && ret_val;
+
+    sync_job_free (job);
+    slicer_free (slicer);
+
+    return ret_val;
+}
+
+int
+main (int argc, char *argv[])
+{
+    NPNetscapeFuncs funcs;
+    A2DAsyncTarget *target;
+    gchar *root, *directory;
+    gboolean success = TRUE;
+
+    root = g_dir_make_tmp ("a2d-test-sync-XXXXXX", NULL);
+    if (!root)
+        return 1;
+
+    directory = g_build_filename (root, "config", NULL);
+    g_setenv ("XDG_CONFIG_HOME", directory, TRUE);
+    g_free (directory);
+    directory = g_build_filename (root, "data", NULL);
+    g_setenv ("XDG_DATA_HOME", directory, TRUE);
+    g_free (directory);
+    g_setenv ("CHROME_WRAPPER", "/usr/bin/google-chrome", TRUE);
+
+    directory = g_build_filename (g_get_user_data_dir (), "applications", NULL);
+    g_mkdir_with_parents (directory, 0700);
+    g_free (directory);
+    directory = g_build_filename (g_get_user_data_dir (), "apps2desktop", NULL);
+    g_mkdir_with_parents (directory, 0700);
+    g_free (directory);
+
+    create_extension (APP_X);
+    create_extension (APP_Y);
+
+    memset (&funcs, 0, sizeof (funcs));
+    funcs.pluginthreadasynccall = test_async_call;
+    npnfuncs = &funcs;
+
+    /* Operations of a batch run one after another */
+    threads = 1;
+    initialize ();
+
+    target = g_new0 (A2DAsyncTarget, 1);
+    target->ref_count = 1;
+    target->instance = &test_instance;
+
+    success = test_worker (target) && success;
+    success = test_slices (target) && success;
+
+    async_target_unref (target);
+    a2d_plugin_shutdown ();
+
+    directory = g_strdup_printf ("rm -rf '%s'", root);
+    if (system (directory) != 0)
+        g_printerr ("Can't remove %s\n", root);
+    g_free (directory);
+    g_free (root);
+
+    return success ? 0 : 1;
+}